@@ -0,0 +1,145 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "block_cache.hpp"
+#include "dictionary.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+using namespace std;
+
+/** Number of 32-bit values in the header of cache files. */
+static const u32 CacheHeader = 3;
+
+/** Number of rebuilds a block is kept for without being used. */
+static const u32 MaxAge = 16;
+
+BlockCache::BlockCache (const Dictionary &dic) : m_hash(dic.checksum())
+{
+}
+
+void BlockCache::loadFromFile (const string &file)
+{
+   if (!boost::filesystem::exists(file)) return;
+
+   try
+   {
+      boost::iostreams::mapped_file_source cache(file);
+      const u8 *data = (const u8 *)cache.data(), *end = data + cache.size();
+      const u32 *header = (const u32 *)data;
+
+      if (cache.size() < CacheHeader * sizeof(u32) || !equal(data, data + 4, "PBC1") || header[1] != m_hash)
+         return;
+
+      data += CacheHeader * sizeof(u32);
+
+      // each block: both hashes, its age and length, then its bytes
+      for (u32 i = 0; i < header[2] && end - data >= 16; i++)
+      {
+         const u32 *entry = (const u32 *)data;
+         if (static_cast<u32>(end - data) - 16 < entry[3]) break;
+
+         CachedBlock &block = m_blocks[make_pair(entry[0], entry[1])];
+         block.age = entry[2] + 1;
+         block.data.assign(data + 16, data + 16 + entry[3]);
+
+         data += 16 + entry[3];
+      }
+   }
+   catch (const exception &) {
+      // an empty or unreadable cache is dropped, so every block is encoded again
+      m_blocks.clear();
+   }
+}
+
+void BlockCache::saveToFile (const string &file) const
+{
+   vector<u8> data(CacheHeader * sizeof(u32));
+   u32 count = 0;
+
+   for (map<key_type, CachedBlock>::const_iterator i = m_blocks.begin(); i != m_blocks.end(); ++i)
+   {
+      if (i->second.age >= MaxAge) continue;
+
+      u32 entry[4] = { i->first.first, i->first.second, i->second.age, static_cast<u32>(i->second.data.size()) };
+
+      data.insert(data.end(), (const u8 *)entry, (const u8 *)(entry + 4));
+      data.insert(data.end(), i->second.data.begin(), i->second.data.end());
+      count++;
+   }
+
+   u32 *header = (u32 *)&data[0];
+
+   copy("PBC1", "PBC1" + 4, data.begin());
+   header[1] = m_hash;
+   header[2] = count;
+
+   // written aside and then moved into place, so an interrupted write doesn't leave
+   // a damaged cache behind (it only saves time, so failing to write it isn't an error)
+   string temp = file + ".tmp";
+   ofstream cache(temp.c_str(), ios::binary);
+   cache.write((const char *)&data[0], data.size());
+   cache.close();
+
+   boost::system::error_code error;
+
+   if (cache) boost::filesystem::rename(temp, file, error);
+   if (!cache || error) boost::filesystem::remove(temp, error);
+}
+
+/**
+* Two unrelated hashes (CRC-32 and FNV-1a) are taken, so blocks with the
+* same key can be told to have the same text.
+*/
+BlockCache::key_type BlockCache::key (const char *first, const char *last, u32 flags)
+{
+   boost::crc_32_type crc;
+   crc.process_bytes(first, last - first);
+   crc.process_bytes(&flags, sizeof(flags));
+
+   u32 fnv = 2166136261u ^ flags;
+   for (const char *i = first; i != last; ++i)
+      fnv = (fnv ^ static_cast<u8>(*i)) * 16777619u;
+
+   return make_pair(crc.checksum(), fnv);
+}
+
+bool BlockCache::find (const key_type &key, u8 *buffer, u32 &length)
+{
+   map<key_type, CachedBlock>::iterator found = m_blocks.find(key);
+   if (found == m_blocks.end()) return false;
+
+   found->second.age = 0;
+   length = static_cast<u32>(found->second.data.size());
+   copy(found->second.data.begin(), found->second.data.end(), buffer);
+
+   return true;
+}
+
+void BlockCache::insert (const key_type &key, const u8 *first, const u8 *last)
+{
+   CachedBlock &block = m_blocks[key];
+
+   block.data.assign(first, last);
+   block.age = 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef BLOCKCACHE_HPP
+#define BLOCKCACHE_HPP
+
+#include <map>
+#include <vector>
+#include <string>
+#include <utility>
+#include "common.hpp"
+
+class Dictionary;
+
+/**
+* Encoded bytes of the blocks of text already inserted, looked up by the
+* hash of their text. Kept between rebuilds (in a cache file), so only the
+* blocks changed since the last one have to be encoded again. The whole
+* cache is dropped whenever the table it was built with changes.
+*/
+class BlockCache
+{
+public:
+   /** Hashes of the text of a block, along with the way it's encoded */
+   typedef std::pair<u32, u32> key_type;
+
+   /**
+   * Creates an empty cache for a table.
+   * @param dic Table the blocks are encoded with.
+   */
+   explicit BlockCache (const Dictionary &dic);
+
+   /**
+   * Loads the blocks saved by an earlier rebuild. A missing, outdated or
+   * unreadable cache file is ignored.
+   * @param file Path to the cache file.
+   */
+   void loadFromFile (const std::string &file);
+
+   /**
+   * Saves the blocks into a cache file. Blocks left unused for a number
+   * of rebuilds in a row are dropped, so the file doesn't keep growing.
+   * @param file Path to the cache file.
+   */
+   void saveToFile (const std::string &file) const;
+
+   /**
+   * Hashes the text of a block.
+   * @param first Start of the text.
+   * @param last End of the text.
+   * @param flags Anything else the encoded bytes depend on.
+   * @return Key of the block.
+   */
+   static key_type key (const char *first, const char *last, u32 flags);
+
+   /**
+   * Looks up the encoded bytes of a block.
+   * @param key Key of the block.
+   * @param buffer Where the bytes are copied to, if found.
+   * @param length Set to the number of bytes copied.
+   * @return True if the block was found.
+   */
+   bool find (const key_type &key, u8 *buffer, u32 &length);
+
+   /**
+   * Stores the encoded bytes of a block.
+   * @param key Key of the block.
+   * @param first Start of the bytes.
+   * @param last End of the bytes.
+   */
+   void insert (const key_type &key, const u8 *first, const u8 *last);
+
+private:
+   /** Encoded bytes of a block */
+   typedef struct tagFF8CachedBlock {
+      std::vector<u8> data; /**< The encoded bytes.                     */
+      u32 age;              /**< Rebuilds since the block was last used. */
+   } CachedBlock;
+
+   u32 m_hash;                               /**< Checksum of the table.  */
+   std::map<key_type, CachedBlock> m_blocks; /**< Blocks, by their keys.  */
+};
+
+#endif //~BLOCKCACHE_HPP
\ No newline at end of file
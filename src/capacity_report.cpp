@@ -0,0 +1,137 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "capacity_report.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+
+using namespace std;
+using boost::format;
+
+/**
+* Adds a section to be measured.
+* @param name Name shown in the report.
+* @param data The original file, shared by all of its sections.
+* @param script Script to be measured.
+* @param modified Whether the script was changed.
+* @param type Format of the section.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the text data (optional).
+*/
+void CapacityReport::add (const string &name, const filedata_type &data, const string &script,
+   bool modified, int type, u32 ptrOff, u32 txtOff)
+{
+   Entry entry;
+   entry.name = name;
+   entry.data = data;
+   entry.script = script;
+   entry.modified = modified;
+   entry.type = type;
+   entry.ptrOff = ptrOff;
+   entry.txtOff = txtOff;
+
+   m_entries.push_back(entry);
+}
+
+/**
+* Measures every section, splitting them between several threads. The files
+* are only read by the dry runs, so their sections may be measured at once.
+* An error in one section doesn't stop the others.
+*/
+void CapacityReport::measure ()
+{
+   if (m_entries.empty()) return;
+
+   Parallel::run(static_cast<u32>(m_entries.size()), boost::bind(&CapacityReport::measureRange, this, &m_entries[0], _1, _2));
+}
+
+/**
+* Measures a share of the sections. The inserter is kept while the sections
+* belong to the same file.
+* @param entries The sections.
+* @param first First section of the share.
+* @param last Section after the last one.
+*/
+void CapacityReport::measureRange (Entry *entries, u32 first, u32 last) const
+{
+   boost::shared_ptr<TextInserter> inserter;
+   const u8 *file = 0;
+
+   for (Entry *cur = entries + first; cur != entries + last; ++cur)
+   {
+      try
+      {
+         if (!inserter || file != cur->data.first.get())
+         {
+            inserter.reset(new TextInserter(cur->data, m_tbl));
+            inserter->compaction(m_compaction);
+            file = cur->data.first.get();
+         }
+
+         cur->room = inserter->measure(cur->script, cur->type, cur->ptrOff, cur->txtOff);
+      }
+      catch (const exception &e) {
+         cur->error = e.what();
+      }
+   }
+}
+
+/**
+* Prints a line for each section and the totals. Each section shows how
+* many bytes are left in the room of the original text, negative if it
+* doesn't fit, unless the file can grow to make room for it.
+* Changed scripts are marked with an asterisk.
+* @param out Where the report is printed.
+*/
+void CapacityReport::print (ostream &out) const
+{
+   u32 original = 0, slack = 0, encoded = 0, over = 0, failed = 0;
+
+   out << format("%1$-44s %2$9s %3$7s %4$9s %5$8s") % "Section" % "Original" % "Slack" % "Encoded" % "Free" << endl;
+
+   for (vector<Entry>::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+   {
+      string name = (i->modified ? "*" : " ") + i->name;
+
+      if (!i->error.empty())
+      {
+         out << format("%1$-44s Error: %2%") % name % i->error << endl;
+         failed++;
+         continue;
+      }
+
+      const TextInserter::Capacity &room = i->room;
+      int free = static_cast<int>(room.original + room.slack) - static_cast<int>(room.encoded);
+
+      string status = (format("%1%") % free).str();
+      if (free < 0 && !room.limited) status = "grows";
+      else if (free < 0) over++;
+
+      out << format("%1$-44s %2$9u %3$7u %4$9u %5$8s") % name % room.original % room.slack % room.encoded % status << endl;
+
+      original += room.original, slack += room.slack, encoded += room.encoded;
+   }
+
+   out << endl << format("%1$-44s %2$9u %3$7u %4$9u") % "Total" % original % slack % encoded << endl;
+   out << over << " sections don't fit, " << failed << " couldn't be measured." << endl;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef CAPACITYREPORT_HPP
+#define CAPACITYREPORT_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "common.hpp"
+#include "dictionary.hpp"
+#include "text_inserter.hpp"
+
+/**
+* Tells how much room the text of every section of a disc takes, before and
+* after its script was changed. Each section is measured by a dry run of the
+* inserter, so the layout is the same one a rebuild would use, and the
+* sections are split between several threads.
+*/
+class CapacityReport
+{
+public:
+   typedef TextInserter::filedata_type filedata_type;
+
+   /** A section of a file, along with its sizes once measured */
+   typedef struct tagFF8CapacityEntry {
+      std::string name;              /**< Name shown in the report.                      */
+      filedata_type data;            /**< The original file (decompressed).              */
+      std::string script;            /**< Script measured.                               */
+      bool modified;                 /**< Whether the script was changed.                */
+      int type;                      /**< Format of the section.                         */
+      u32 ptrOff;                    /**< Offset of the pointers table.                  */
+      u32 txtOff;                    /**< Offset of the text data.                       */
+      TextInserter::Capacity room;   /**< Sizes found by the dry run.                    */
+      std::string error;             /**< Why it couldn't be measured (empty if it was). */
+   } Entry;
+
+   /**
+   * @param dic Table used to encode the scripts.
+   * @param compaction Whether repeated menu strings share their storage.
+   */
+   CapacityReport (const Dictionary &dic, bool compaction) : m_tbl(dic), m_compaction(compaction) { }
+
+   void add (const std::string &name, const filedata_type &data, const std::string &script,
+      bool modified, int type, u32 ptrOff = 0, u32 txtOff = 0);
+
+   void measure ();
+   void print (std::ostream &out) const;
+
+   /**
+   * Gets the sections, in the order they were added.
+   * @return The sections.
+   */
+   const std::vector<Entry> &entries () const { return m_entries; }
+
+private:
+   void measureRange (Entry *entries, u32 first, u32 last) const;
+
+   const Dictionary &m_tbl;      /**< Table used to encode the scripts.        */
+   bool m_compaction;            /**< Whether repeated strings share storage.  */
+   std::vector<Entry> m_entries; /**< Sections of the disc.                    */
+};
+
+#endif //~CAPACITYREPORT_HPP
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "code_usage.hpp"
+#include "dictionary.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <boost/format.hpp>
+
+using namespace std;
+
+/**
+* Tells whether two fragments of text are different.
+*/
+static bool differs (const DictionaryView::Fragment &a, const DictionaryView::Fragment &b)
+{
+   return a.length != b.length || !equal(a.text, a.text + a.length, b.text);
+}
+
+/**
+* Restores a bitmap created by the toString method.
+* @param value The bitmap, as an hexstring.
+*/
+CodeUsage::CodeUsage (const string &value)
+{
+   clear();
+
+   for (u32 i = 0; i < NumBytes && i * 2 + 1 < value.size(); i++)
+      m_bits[i] = hexDecode<u8>(value.substr(i * 2, 2));
+}
+
+/**
+* Finds the codes whose text differs between two tables, comparing the
+* text written into the scripts (so a missing entry and its bracketed
+* value are the same).
+* @param before The old table.
+* @param after The new table.
+* @return Bitmap of the changed codes.
+*/
+CodeUsage CodeUsage::changes (const Dictionary &before, const Dictionary &after)
+{
+   const DictionaryView &a = before.view(), &b = after.view();
+   CodeUsage result;
+
+   for (u32 i = 0; i < 256; i++)
+   {
+      u8 value = static_cast<u8>(i);
+      if (differs(a.byte(value), b.byte(value))) result.markByte(value);
+
+      for (u8 prefix = DictionaryView::FirstMte; prefix <= DictionaryView::LastMte; prefix++)
+         if (differs(a.mte(prefix, value), b.mte(prefix, value))) result.markMte(prefix, value);
+   }
+
+   return result;
+}
+
+bool CodeUsage::intersects (const CodeUsage &other) const
+{
+   for (u32 i = 0; i < NumBytes; i++)
+      if (m_bits[i] & other.m_bits[i]) return true;
+
+   return false;
+}
+
+bool CodeUsage::empty () const
+{
+   return find_if(m_bits, m_bits + NumBytes, bind2nd(not_equal_to<u8>(), 0)) == m_bits + NumBytes;
+}
+
+string CodeUsage::toString () const
+{
+   u32 used = NumBytes;
+   while (used && !m_bits[used - 1]) used--;
+
+   string result;
+   for (u32 i = 0; i < used; i++)
+      result += (boost::format("%1$02X") % int(m_bits[i])).str();
+
+   return result;
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef CODEUSAGE_HPP
+#define CODEUSAGE_HPP
+
+#include <string>
+#include <algorithm>
+#include "common.hpp"
+#include "dictionary_view.hpp"
+
+class Dictionary;
+
+/**
+* Bitmap of the codes (single bytes and multi-byte codes) found in some
+* text. Kept for each dumped script, so only the scripts using the entries
+* changed in a table have to be dumped again.
+*/
+class CodeUsage
+{
+public:
+   CodeUsage () { clear(); }
+
+   /**
+   * Restores a bitmap created by the toString method.
+   * @param value The bitmap, as an hexstring.
+   */
+   explicit CodeUsage (const std::string &value);
+
+   /**
+   * Finds the codes whose text differs between two tables.
+   * @param before The old table.
+   * @param after The new table.
+   * @return Bitmap of the changed codes.
+   */
+   static CodeUsage changes (const Dictionary &before, const Dictionary &after);
+
+   void clear () { std::fill(m_bits, m_bits + NumBytes, 0); }
+
+   void markByte (u8 value) { set(value); }
+   void markMte (u8 prefix, u8 value) { set(256 + (prefix - DictionaryView::FirstMte) * 256 + value); }
+
+   /**
+   * Checks whether any code is found in both bitmaps.
+   * @param other The other bitmap.
+   * @return True if they have any code in common.
+   */
+   bool intersects (const CodeUsage &other) const;
+
+   /**
+   * Checks whether no code was marked.
+   * @return True if the bitmap is empty.
+   */
+   bool empty () const;
+
+   /**
+   * Converts the bitmap into an hexstring, without the trailing zeros.
+   * @return The bitmap, as an hexstring.
+   */
+   std::string toString () const;
+
+private:
+   enum {
+      NumCodes = (1 + DictionaryView::LastMte - DictionaryView::FirstMte + 1) * 256, /**< Bytes and multi-byte codes */
+      NumBytes = NumCodes / 8                                                          /**< Size of the bitmap         */
+   };
+
+   void set (u32 code) { m_bits[code >> 3] |= 1 << (code & 7); }
+
+   u8 m_bits[NumBytes]; /**< One bit per code, single bytes first. */
+};
+
+#endif //~CODEUSAGE_HPP
\ No newline at end of file
@@ -20,17 +20,52 @@
 
 #include <fstream>
 #include <iomanip>
+#include <iterator>
+#include <algorithm>
 #include <exception>
-#include <boost/regex.hpp>
+#include <cctype>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 using namespace std;
 
+/** Number of 32-bit values in the header of table snapshots. */
+static const u32 SnapshotHeader = 4;
+
+/**
+* Appends a table entry to a snapshot.
+* @param dest Snapshot data.
+* @param key Key of the entry.
+* @param value Value of the entry.
+*/
+static void appendEntry (vector<u8> &dest, u16 key, const string &value)
+{
+   u16 len = static_cast<u16>(value.size());
+
+   dest.insert(dest.end(), (const u8 *)&key, (const u8 *)&key + 2);
+   dest.insert(dest.end(), (const u8 *)&len, (const u8 *)&len + 2);
+   dest.insert(dest.end(), value.begin(), value.end());
+}
+
 template <> void Dictionary::insert<u8> (const u8 key, const string value) {
    m_8b.insert(dic_entry8b(key, value));
+   m_view.reset(), m_trie.reset();
 }
 
 template <> void Dictionary::insert<u16> (const u16 key, const string value) {
    m_16b.insert(dic_entry16b(key, value));
+   m_view.reset(), m_trie.reset();
+}
+
+template <> void Dictionary::remove<u8> (const u8 key) {
+   m_8b.left.erase(key);
+   m_view.reset(), m_trie.reset();
+}
+
+template <> void Dictionary::remove<u16> (const u16 key) {
+   m_16b.left.erase(key);
+   m_view.reset(), m_trie.reset();
 }
 
 template <> string Dictionary::find<u8> (const u8 key) const {
@@ -57,41 +92,191 @@ template <> bool Dictionary::exists<u16> (const string &value) const {
    return m_16b.right.count(value) ? true : false;
 }
 
-void Dictionary::loadFromFile(const string &file)
+void Dictionary::loadFromFile (const string &file, bool useSnapshot)
 {
    ifstream tbl(file);
    if (!tbl) throw exception(("Failed to open " + file).c_str());
 
-   while (!tbl.eof())
+   string data((istreambuf_iterator<char>(tbl)), istreambuf_iterator<char>());
+
+   boost::crc_32_type crc;
+   crc.process_bytes(data.data(), data.size());
+
+   string snapshot = file + ".snapshot";
+   if (useSnapshot && loadSnapshot(snapshot, crc.checksum())) return;
+
+   parse(data.data(), data.data() + data.size());
+
+   // compiled right away, so it's ready before any threads use it
+   m_view.reset(new DictionaryView(*this));
+   m_trie.reset(new DictionaryTrie(*this));
+
+   if (useSnapshot) saveSnapshot(snapshot, crc.checksum());
+}
+
+/**
+* Parses the entries of a table file, which match the HH=* or HHHH=* patterns.
+* Any other lines are ignored.
+* @param first Start of the table data.
+* @param last End of the table data.
+*/
+void Dictionary::parse (const char *first, const char *last)
+{
+   while (first != last)
    {
-      string line;
-      getline(tbl, line);
+      const char *eol = std::find(first, last, '\n');
+      const char *sep = std::find(first, eol, '=');
+
+      int digits = static_cast<int>(sep - first);
+      bool valid = (digits == 2 || digits == 4) && sep + 1 < eol;
 
-      // matches HH=* or HHHH=* pattern
-      const boost::regex e("^([\\dABCDEFabcdef]{2}|[\\dABCDEFabcdef]{4})=(.+)");
-      boost::smatch what;
+      for (const char *i = first; valid && i != sep; ++i)
+         valid = isxdigit(static_cast<u8>(*i)) != 0;
 
-      if (boost::regex_match(line, what, e))
+      if (valid)
       {
-         string key = what[1];
-         u16 tmp = static_cast<u16> (strtoul(key.c_str(), 0, 16));
+         u16 key = hexDecode<u16>(string(first, sep));
+         string value(sep + 1, eol);
 
-         if (key.size() == 2) m_8b.insert(dic_entry8b(static_cast <u8> (tmp & 0xff), what[2]));
-         else if (key.size() == 4) m_16b.insert(dic_entry16b(tmp, what[2]));
+         if (digits == 2) m_8b.insert(dic_entry8b(static_cast<u8>(key), value));
+         else m_16b.insert(dic_entry16b(key, value));
       }
+
+      first = eol == last ? last : eol + 1;
    }
 }
 
-void Dictionary::saveToFile (const string &file)
+/**
+* Loads the entries and compiled tables from a snapshot of the table file.
+* @param file Path to the snapshot.
+* @param hash Checksum of the table file.
+* @return True if the snapshot was loaded, false if it's missing, outdated or
+*         damaged (when nothing is kept from it).
+*/
+bool Dictionary::loadSnapshot (const string &file, u32 hash)
+{
+   if (!boost::filesystem::exists(file)) return false;
+
+   try
+   {
+      boost::iostreams::mapped_file_source snapshot(file);
+      const u8 *data = (const u8 *)snapshot.data(), *end = data + snapshot.size();
+      const u32 *header = (const u32 *)data;
+
+      if (snapshot.size() < SnapshotHeader * sizeof(u32) || !equal(data, data + 4, "PTB1") || header[1] != hash)
+         return false;
+
+      data += SnapshotHeader * sizeof(u32);
+
+      for (u32 i = 0; i < header[2] + header[3]; i++)
+      {
+         if (end - data < 4) throw exception("The table snapshot is truncated.");
+
+         u16 key = *((const u16 *)data), len = *((const u16 *)data + 1);
+         if (end - data - 4 < len) throw exception("The table snapshot is truncated.");
+
+         string value((const char *)data + 4, len);
+
+         if (i < header[2]) m_8b.insert(dic_entry8b(static_cast<u8>(key), value));
+         else m_16b.insert(dic_entry16b(key, value));
+
+         data += 4 + len;
+      }
+
+      m_view.reset(new DictionaryView(data, end));
+      m_trie.reset(new DictionaryTrie(data, end));
+
+      if (data != end) throw exception("The table snapshot is corrupt.");
+   }
+   catch (const exception &) {
+      // the table file is parsed instead
+      m_8b.clear(), m_16b.clear();
+      m_view.reset(), m_trie.reset();
+
+      return false;
+   }
+
+   return true;
+}
+
+/**
+* Saves the entries and compiled tables into a snapshot of the table file.
+* @param file Path to the snapshot.
+* @param hash Checksum of the table file.
+*/
+void Dictionary::saveSnapshot (const string &file, u32 hash) const
+{
+   vector<u8> data(SnapshotHeader * sizeof(u32));
+   u32 *header = (u32 *)&data[0];
+
+   copy("PTB1", "PTB1" + 4, data.begin());
+   header[1] = hash;
+   header[2] = static_cast<u32>(m_8b.size());
+   header[3] = static_cast<u32>(m_16b.size());
+
+   for (dic_type8b::const_iterator i = m_8b.begin(); i != m_8b.end(); ++i)
+      appendEntry(data, i->left, i->right);
+
+   for (dic_type16b::const_iterator i = m_16b.begin(); i != m_16b.end(); ++i)
+      appendEntry(data, i->left, i->right);
+
+   m_view->serialize(data);
+   m_trie->serialize(data);
+
+   // written aside and then moved into place, so an interrupted write doesn't leave
+   // a truncated snapshot behind (it's only a cache, so failing to write it isn't an error)
+   string temp = file + ".tmp";
+   ofstream snapshot(temp.c_str(), ios::binary);
+   snapshot.write((const char *)&data[0], data.size());
+   snapshot.close();
+
+   boost::system::error_code error;
+
+   if (snapshot) boost::filesystem::rename(temp, file, error);
+   if (!snapshot || error) boost::filesystem::remove(temp, error);
+}
+
+const DictionaryView &Dictionary::view () const
+{
+   if (!m_view) m_view.reset(new DictionaryView(*this));
+   return *m_view;
+}
+
+const DictionaryTrie &Dictionary::trie () const
+{
+   if (!m_trie) m_trie.reset(new DictionaryTrie(*this));
+   return *m_trie;
+}
+
+u32 Dictionary::checksum () const
+{
+   vector<u8> data;
+
+   for (dic_type8b::const_iterator i = m_8b.begin(); i != m_8b.end(); ++i)
+      appendEntry(data, i->left, i->right);
+
+   // keeps a 8-bit entry from matching a 16-bit one
+   data.push_back(0xff);
+
+   for (dic_type16b::const_iterator i = m_16b.begin(); i != m_16b.end(); ++i)
+      appendEntry(data, i->left, i->right);
+
+   boost::crc_32_type crc;
+   crc.process_bytes(data.empty() ? 0 : &data[0], data.size());
+
+   return crc.checksum();
+}
+
+void Dictionary::saveToFile (const string &file) const
 {
    ofstream tbl(file);
    if (!tbl) throw exception(("Failed to create " + file).c_str());
 
-   for (dic_type8b::iterator i = m_8b.begin(); i != m_8b.end(); ++i)
+   for (dic_type8b::const_iterator i = m_8b.begin(); i != m_8b.end(); ++i)
       tbl << hex << uppercase << setw(2) << setfill('0')
           << (short)i->left << "=" << i->right << endl;
 
-   for (dic_type16b::iterator i = m_16b.begin(); i != m_16b.end(); ++i)
+   for (dic_type16b::const_iterator i = m_16b.begin(); i != m_16b.end(); ++i)
       tbl << hex << uppercase << setw(4) << setfill('0')
           << i->left << "=" << i->right << endl;
 }
\ No newline at end of file
@@ -21,8 +21,11 @@
 
 #include <string>
 #include <boost/bimap.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "common.hpp"
+#include "dictionary_view.hpp"
+#include "dictionary_trie.hpp"
 
 /**
 * Implements a dictionary-like functionality matching 8 and 16-bit data
@@ -41,14 +44,17 @@ public:
    /**
    * Loads the dictionary data from a Thingy table file.
    * @param file Path to the table file
+   * @param useSnapshot Whether to keep a binary snapshot (file.snapshot) of the
+   *                    parsed entries and compiled tables, used while the table
+   *                    file doesn't change.
    */
-   void loadFromFile (const std::string &file);
+   void loadFromFile (const std::string &file, bool useSnapshot = false);
 
    /**
    * Stores the dictionary data into a Thingy table file.
    * @param file Path to the table file
    */
-   void saveToFile (const std::string &file);
+   void saveToFile (const std::string &file) const;
 
    /**
    * Inserts a new entry in the dictionary.
@@ -57,6 +63,12 @@ public:
    */
    template <typename T> void insert (const T key, const std::string value);
 
+   /**
+   * Removes an entry from the dictionary.
+   * @param key The key of the entry
+   */
+   template <typename T> void remove (const T key);
+
    /**
    * Finds the value of a given key in the dictionary.
    * @param key The target key
@@ -78,9 +90,36 @@ public:
    */
    template <typename T> bool exists (const std::string &value) const;
 
+   /**
+   * Gets the flat lookup tables compiled from the dictionary, used to decode
+   * text. They're compiled when the table file is loaded, or on first use.
+   * @return The compiled view of the dictionary.
+   */
+   const DictionaryView &view () const;
+
+   /**
+   * Gets the trie compiled from the 8-bit entries, used to encode text.
+   * It's compiled when the table file is loaded, or on first use.
+   * @return The compiled trie.
+   */
+   const DictionaryTrie &trie () const;
+
+   /**
+   * Calculates a checksum of the entries, which changes along with any of them.
+   * @return CRC-32 of the entries.
+   */
+   u32 checksum () const;
+
 private:
+   void parse (const char *first, const char *last);
+   bool loadSnapshot (const std::string &file, u32 hash);
+   void saveSnapshot (const std::string &file, u32 hash) const;
+
    dic_type8b m_8b;   /**< Bimap containing 8-bit entries */
    dic_type16b m_16b; /**< Bimap containing 16-bit entries */
+
+   mutable boost::shared_ptr<const DictionaryView> m_view; /**< Compiled lookup tables */
+   mutable boost::shared_ptr<const DictionaryTrie> m_trie; /**< Compiled reverse lookup */
 };
 
 #endif //~DICTIONARY_HPP
\ No newline at end of file
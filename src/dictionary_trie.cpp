@@ -0,0 +1,172 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "dictionary_trie.hpp"
+#include "dictionary.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+/**
+* Compiles the trie out of the 8-bit entries of a dictionary.
+* @param dic The dictionary.
+*/
+DictionaryTrie::DictionaryTrie (const Dictionary &dic) : m_nodes(1)
+{
+   for (u32 i = 0; i < 256; i++)
+   {
+      string value = dic.find<u8>(static_cast<u8>(i));
+      u32 node = 0;
+
+      for (string::iterator c = value.begin(); c != value.end(); ++c)
+      {
+         u16 &next = m_nodes[node].next[static_cast<u8>(*c)];
+
+         if (!next)
+         {
+            if (m_nodes.size() > 0xffff) throw exception("Too many dictionary entries.");
+
+            next = static_cast<u16>(m_nodes.size());
+            m_nodes.push_back(Node());
+         }
+
+         // the reference may be invalidated by push_back
+         node = m_nodes[node].next[static_cast<u8>(*c)];
+      }
+
+      if (node) m_nodes[node].code = static_cast<int>(i);
+   }
+}
+
+/**
+* Restores the trie from data created by the serialize method.
+* @param data Pointer to the data, updated to the position right after it.
+* @param end End of the data. Throws if the data doesn't fit before it.
+*/
+DictionaryTrie::DictionaryTrie (const u8 *&data, const u8 *end)
+{
+   const u32 nodeLen = sizeof(m_nodes[0].next) + sizeof(int);
+
+   if (end - data < static_cast<ptrdiff_t>(sizeof(u32))) throw exception("The table snapshot is truncated.");
+
+   u32 numNodes = *((const u32 *)data);
+   data += sizeof(u32);
+
+   // there's always a root, and the children are numbered by 16 bits
+   if (!numNodes || numNodes > 0x10000) throw exception("The table snapshot is corrupt.");
+   if (static_cast<u32>(end - data) / nodeLen < numNodes) throw exception("The table snapshot is truncated.");
+
+   m_nodes.resize(numNodes);
+
+   for (vector<Node>::iterator i = m_nodes.begin(); i != m_nodes.end(); ++i)
+   {
+      copy(data, data + sizeof(i->next), (u8 *)i->next);
+      data += sizeof(i->next);
+
+      i->code = *((const int *)data);
+      data += sizeof(int);
+
+      if (i->code > 0xff || *max_element(i->next, i->next + 256) >= numNodes)
+         throw exception("The table snapshot is corrupt.");
+   }
+}
+
+/**
+* Appends the trie to a buffer, so it can be restored later.
+* @param dest Buffer where the data will be appended.
+*/
+void DictionaryTrie::serialize (vector<u8> &dest) const
+{
+   u32 numNodes = static_cast<u32>(m_nodes.size());
+   dest.insert(dest.end(), (const u8 *)&numNodes, (const u8 *)&numNodes + sizeof(numNodes));
+
+   for (vector<Node>::const_iterator i = m_nodes.begin(); i != m_nodes.end(); ++i)
+   {
+      dest.insert(dest.end(), (const u8 *)i->next, (const u8 *)i->next + sizeof(i->next));
+      dest.insert(dest.end(), (const u8 *)&i->code, (const u8 *)&i->code + sizeof(int));
+   }
+}
+
+/**
+* Encodes a piece of text, which can't contain any codes or line breaks.
+* The optimal encoding is found from the end of the text backwards: for
+* each position, the entry leading to the fewest bytes up to the end.
+* @param first Start of the text.
+* @param last End of the text.
+* @param dest Where the encoded text will be written to.
+* @param multiChar Whether entries longer than one character can be used.
+* @param optimal Whether to use the fewest bytes possible, instead of
+*                always taking the longest entry at each position.
+* @return Number of bytes written.
+*/
+u32 DictionaryTrie::encode (const char *first, const char *last, u8 *dest, bool multiChar, bool optimal) const
+{
+   u32 tail = 0;
+
+   if (!optimal || !multiChar)
+   {
+      for (const char *i = first; i != last; tail++)
+      {
+         u32 len = match(i, last, dest[tail], multiChar);
+         if (!len) throw exception("Translation error!");
+
+         i += len;
+      }
+
+      return tail;
+   }
+
+   const u32 unreachable = 0xffffffff;
+   u32 size = static_cast<u32>(last - first);
+
+   // cost (in bytes) from each position to the end, and the entry used there
+   vector<u32> cost(size + 1, unreachable), length(size, 0);
+   vector<u8> code(size, 0);
+   cost[size] = 0;
+
+   for (u32 pos = size; pos-- > 0; )
+   {
+      u32 node = 0;
+
+      for (u32 i = pos; i < size; i++)
+      {
+         node = m_nodes[node].next[static_cast<u8>(first[i])];
+         if (!node) break;
+
+         // on ties, the longest entry wins, like in the greedy encoding
+         if (m_nodes[node].code >= 0 && cost[i + 1] != unreachable && cost[i + 1] + 1 <= cost[pos])
+         {
+            cost[pos] = cost[i + 1] + 1;
+            length[pos] = i - pos + 1;
+            code[pos] = static_cast<u8>(m_nodes[node].code);
+         }
+      }
+   }
+
+   if (cost[0] == unreachable)
+      throw exception("Translation error!");
+
+   for (u32 pos = 0; pos < size; pos += length[pos])
+      dest[tail++] = code[pos];
+
+   return tail;
+}
\ No newline at end of file
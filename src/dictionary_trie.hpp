@@ -0,0 +1,106 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef DICTIONARYTRIE_HPP
+#define DICTIONARYTRIE_HPP
+
+#include <vector>
+#include <algorithm>
+#include "common.hpp"
+
+class Dictionary;
+
+/**
+* Reverse mapping (text to byte) of a dictionary, compiled into a trie.
+* Finding the longest entry matching the start of some text takes a
+* single walk, one table lookup per character.
+*/
+class DictionaryTrie
+{
+public:
+   /**
+   * Compiles the trie out of the 8-bit entries of a dictionary.
+   * @param dic The dictionary.
+   */
+   explicit DictionaryTrie (const Dictionary &dic);
+
+   /**
+   * Restores the trie from data created by the serialize method.
+   * @param data Pointer to the data, updated to the position right after it.
+   * @param end End of the data. Throws if the data doesn't fit before it.
+   */
+   DictionaryTrie (const u8 *&data, const u8 *end);
+
+   /**
+   * Appends the trie to a buffer, so it can be restored later.
+   * @param dest Buffer where the data will be appended.
+   */
+   void serialize (std::vector<u8> &dest) const;
+
+   /**
+   * Encodes a piece of text, which can't contain any codes or line breaks.
+   * @param first Start of the text.
+   * @param last End of the text.
+   * @param dest Where the encoded text will be written to.
+   * @param multiChar Whether entries longer than one character can be used.
+   * @param optimal Whether to use the fewest bytes possible, instead of
+   *                always taking the longest entry at each position.
+   * @return Number of bytes written.
+   */
+   u32 encode (const char *first, const char *last, u8 *dest, bool multiChar = true, bool optimal = true) const;
+
+   /**
+   * Finds the longest entry matching the start of the given text.
+   * @param first Start of the text.
+   * @param last End of the text.
+   * @param code Where the byte matching the entry will be stored.
+   * @param multiChar Whether entries longer than one character can be used.
+   * @return Number of characters matched, 0 if there's no matching entry.
+   */
+   u32 match (const char *first, const char *last, u8 &code, bool multiChar = true) const
+   {
+      u32 len = 0, node = 0;
+
+      for (const char *i = first; i != last; ++i)
+      {
+         node = m_nodes[node].next[static_cast<u8>(*i)];
+         if (!node) break;
+
+         if (m_nodes[node].code >= 0)
+            code = static_cast<u8>(m_nodes[node].code), len = static_cast<u32>(i - first) + 1;
+
+         if (!multiChar) break;
+      }
+
+      return len;
+   }
+
+private:
+   typedef struct tagFF8TrieNode {
+      tagFF8TrieNode () : code(-1) {
+         std::fill(next, next + 256, 0);
+      }
+
+      u16 next[256]; /**< Child for each character (0 if none). */
+      int code;      /**< Byte of the entry ending here, or -1.  */
+   } Node;
+
+   std::vector<Node> m_nodes; /**< All the nodes, starting with the root. */
+};
+
+#endif //~DICTIONARYTRIE_HPP
\ No newline at end of file
@@ -0,0 +1,163 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "dictionary_view.hpp"
+#include "dictionary.hpp"
+
+#include <vector>
+#include <utility>
+#include <exception>
+
+using namespace std;
+
+/**
+* Compiles the tables out of a dictionary. The text of every entry is
+* rendered first and stored in a single string, which the tables point to.
+* @param dic The dictionary.
+*/
+DictionaryView::DictionaryView (const Dictionary &dic)
+{
+   // offset and length of each fragment, since the text may still be reallocated
+   spans_type spans;
+
+   for (u32 i = 0; i < 256; i++)
+   {
+      string raw = dic.find<u8>(static_cast<u8>(i));
+      string text = raw.empty() ? "[" + hexEncode<u8>(static_cast<u8>(i)) + "]" : raw;
+
+      spans.push_back(make_pair(static_cast<u32>(m_text.size()), static_cast<u32>(text.size())));
+      m_text += text;
+
+      spans.push_back(make_pair(static_cast<u32>(m_text.size()), static_cast<u32>(raw.size())));
+      m_text += raw;
+   }
+
+   for (u32 prefix = FirstMte; prefix <= LastMte; prefix++)
+   {
+      for (u32 i = 0; i < 256; i++)
+      {
+         u16 code = static_cast<u16>(prefix << 8 | i);
+
+         string raw = dic.find<u16>(code);
+         string text = "[" + (raw.empty() ? hexEncode<u16>(code) : raw) + "]";
+
+         spans.push_back(make_pair(static_cast<u32>(m_text.size()), static_cast<u32>(text.size())));
+         m_text += text;
+
+         spans.push_back(make_pair(static_cast<u32>(m_text.size()), static_cast<u32>(raw.size())));
+         m_text += raw;
+      }
+   }
+
+   bind(spans);
+}
+
+/**
+* Restores the tables from data created by the serialize method.
+* @param data Pointer to the data, updated to the position right after it.
+* @param end End of the data. Throws if the data doesn't fit before it.
+*/
+DictionaryView::DictionaryView (const u8 *&data, const u8 *end)
+{
+   const u32 *cur = (const u32 *)data;
+   u32 headerLen = (1 + NumFragments * 2) * sizeof(u32);
+
+   if (static_cast<u32>(end - data) < headerLen) throw exception("The table snapshot is truncated.");
+   u32 textLen = *cur++;
+
+   if (static_cast<u32>(end - data) - headerLen < textLen) throw exception("The table snapshot is truncated.");
+
+   spans_type spans(NumFragments);
+
+   for (spans_type::iterator i = spans.begin(); i != spans.end(); ++i)
+   {
+      i->first = *cur++, i->second = *cur++;
+      if (i->first > textLen || i->second > textLen - i->first) throw exception("The table snapshot is corrupt.");
+   }
+
+   m_text.assign((const char *)cur, textLen);
+   data = (const u8 *)cur + textLen;
+
+   bind(spans);
+}
+
+/**
+* Appends the tables to a buffer, so they can be restored later. The
+* fragments are stored as offsets into the text, which comes last.
+* @param dest Buffer where the data will be appended.
+*/
+void DictionaryView::serialize (vector<u8> &dest) const
+{
+   vector<u32> header(1, static_cast<u32>(m_text.size()));
+   const Fragment *tables[] = { &m_bytes[0], &m_rawBytes[0], &m_mtes[0][0], &m_rawMtes[0][0] };
+
+   // same order used when the tables are bound
+   for (u32 i = 0; i < 256; i++)
+   {
+      for (int t = 0; t < 2; t++)
+      {
+         header.push_back(static_cast<u32>(tables[t][i].text - m_text.data()));
+         header.push_back(tables[t][i].length);
+      }
+   }
+
+   for (u32 i = 0; i < NumMtes * 256; i++)
+   {
+      for (int t = 2; t < 4; t++)
+      {
+         header.push_back(static_cast<u32>(tables[t][i].text - m_text.data()));
+         header.push_back(tables[t][i].length);
+      }
+   }
+
+   const u8 *headerPtr = (const u8 *)&header[0];
+   dest.insert(dest.end(), headerPtr, headerPtr + header.size() * sizeof(u32));
+   dest.insert(dest.end(), m_text.begin(), m_text.end());
+}
+
+/**
+* Points the tables to the text, which can't be changed from now on.
+* @param spans Offset and length of each fragment, as rendered and raw.
+*/
+void DictionaryView::bind (const spans_type &spans)
+{
+   spans_type::const_iterator span = spans.begin();
+
+   for (u32 i = 0; i < 256; i++)
+   {
+      Fragment text = { m_text.data() + span->first, span->second };
+      ++span;
+      Fragment raw = { m_text.data() + span->first, span->second };
+      ++span;
+
+      m_bytes[i] = text, m_rawBytes[i] = raw;
+   }
+
+   for (u32 prefix = 0; prefix < NumMtes; prefix++)
+   {
+      for (u32 i = 0; i < 256; i++)
+      {
+         Fragment text = { m_text.data() + span->first, span->second };
+         ++span;
+         Fragment raw = { m_text.data() + span->first, span->second };
+         ++span;
+
+         m_mtes[prefix][i] = text, m_rawMtes[prefix][i] = raw;
+      }
+   }
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef DICTIONARYVIEW_HPP
+#define DICTIONARYVIEW_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include "common.hpp"
+
+class Dictionary;
+
+/**
+* Read-only view of a dictionary, compiled into flat tables so decoding
+* a byte (or a multi-byte code) takes a single lookup. Each entry holds
+* the text ready to be written, including the bracketed fallback used
+* for values missing from the dictionary.
+*/
+class DictionaryView : boost::noncopyable
+{
+public:
+   /** A piece of text stored inside the view (not null-terminated) */
+   typedef struct tagFF8TextFragment {
+      const char *text; /**< Pointer to the text.      */
+      u32 length;       /**< Length of the text.       */
+   } Fragment;
+
+   enum {
+      FirstMte = 0x03, /**< First prefix of multi-byte codes */
+      LastMte = 0x0e   /**< Last prefix of multi-byte codes  */
+   };
+
+   /**
+   * Compiles the tables out of a dictionary.
+   * @param dic The dictionary.
+   */
+   explicit DictionaryView (const Dictionary &dic);
+
+   /**
+   * Restores the tables from data created by the serialize method.
+   * @param data Pointer to the data, updated to the position right after it.
+   * @param end End of the data. Throws if the data doesn't fit before it.
+   */
+   DictionaryView (const u8 *&data, const u8 *end);
+
+   /**
+   * Appends the tables to a buffer, so they can be restored later.
+   * @param dest Buffer where the data will be appended.
+   */
+   void serialize (std::vector<u8> &dest) const;
+
+   /**
+   * Text of a single byte, as written in scripts.
+   * @param value The byte.
+   * @return The text, or the value in brackets if it's not in the dictionary.
+   */
+   const Fragment &byte (u8 value) const { return m_bytes[value]; }
+
+   /**
+   * Text of a multi-byte code, as written in scripts (always in brackets).
+   * @param prefix First byte of the code (from 0x03 to 0x0e).
+   * @param value Second byte of the code.
+   * @return The text, or the value itself if it's not in the dictionary.
+   */
+   const Fragment &mte (u8 prefix, u8 value) const { return m_mtes[prefix - FirstMte][value]; }
+
+   /**
+   * Text of a single byte, exactly as found in the dictionary.
+   * @param value The byte.
+   * @return The text, empty if it's not in the dictionary.
+   */
+   const Fragment &rawByte (u8 value) const { return m_rawBytes[value]; }
+
+   /**
+   * Text of a multi-byte code, exactly as found in the dictionary.
+   * @param prefix First byte of the code (from 0x03 to 0x0e).
+   * @param value Second byte of the code.
+   * @return The text, empty if it's not in the dictionary.
+   */
+   const Fragment &rawMte (u8 prefix, u8 value) const { return m_rawMtes[prefix - FirstMte][value]; }
+
+private:
+   enum {
+      NumMtes = LastMte - FirstMte + 1,        /**< Number of multi-byte prefixes */
+      NumFragments = (1 + NumMtes) * 256 * 2   /**< Fragments in all the tables   */
+   };
+
+   typedef std::vector<std::pair<u32, u32> > spans_type;
+
+   void bind (const spans_type &spans);
+
+   std::string m_text;               /**< Text of every fragment.                */
+   Fragment m_bytes[256];            /**< Single bytes, as written.              */
+   Fragment m_mtes[NumMtes][256];    /**< Multi-byte codes, as written.          */
+   Fragment m_rawBytes[256];         /**< Single bytes, from the dictionary.     */
+   Fragment m_rawMtes[NumMtes][256]; /**< Multi-byte codes, from the dictionary. */
+};
+
+#endif //~DICTIONARYVIEW_HPP
\ No newline at end of file
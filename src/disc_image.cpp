@@ -0,0 +1,115 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "disc_image.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+
+/** Sync pattern found at the start of every raw sector. */
+static const u8 SyncPattern[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+
+/**
+* Opens the file, finding out its type from the extension and contents.
+* Disc images starting with a sync pattern have raw sectors.
+* @param fileName Path to the IMG file or disc image.
+* @param discSector Sector position of the IMG file inside the disc image.
+* @param secSize Size of each sector (in bytes).
+*/
+DiscImage::DiscImage (const string &fileName, u32 discSector, u16 secSize) :
+   m_fileName(fileName), m_type(Img), m_discSector(discSector)
+{
+   m_file.open(fileName.c_str(), ios::binary);
+   if (!m_file) throw exception(("Failed to open " + fileName + " file.").c_str());
+
+   if (!isDiscImage(fileName)) return;
+
+   if (secSize != UserData)
+      throw exception(("Unexpected sector size for disc image " + fileName).c_str());
+
+   u8 sync[sizeof(SyncPattern)] = { 0 };
+   m_file.read((char *)sync, sizeof(sync));
+   m_file.clear();
+
+   m_type = equal(sync, sync + sizeof(sync), SyncPattern) ? Raw : Cooked;
+   if (m_type == Raw) m_buffer.resize(BatchSectors * RawSector);
+}
+
+/**
+* Reads data from the IMG file. Raw sectors are read in batches and only
+* their user data is copied, which starts after the header (and, in mode 2
+* sectors, the subheader).
+* @param offset Offset inside the IMG file.
+* @param dest Where the data will be stored.
+* @param len Length of the data (in bytes).
+*/
+void DiscImage::read (u32 offset, u8 *dest, u32 len)
+{
+   if (m_type != Raw)
+   {
+      streamoff base = m_type == Cooked ? static_cast<streamoff>(m_discSector) * UserData : 0;
+
+      m_file.seekg(base + offset);
+      m_file.read((char *)dest, len);
+
+      if (static_cast<u32>(m_file.gcount()) != len)
+         throw exception(("Unexpected end of " + m_fileName).c_str());
+
+      return;
+   }
+
+   u32 sector = m_discSector + offset / UserData, skip = offset % UserData;
+
+   while (len)
+   {
+      u32 count = min<u32>(BatchSectors, (skip + len + UserData - 1) / UserData);
+
+      m_file.seekg(static_cast<streamoff>(sector) * RawSector);
+      m_file.read((char *)&m_buffer[0], count * RawSector);
+
+      if (static_cast<u32>(m_file.gcount()) != count * RawSector)
+         throw exception(("Unexpected end of " + m_fileName).c_str());
+
+      for (u32 i = 0; i < count; i++)
+      {
+         const u8 *cur = &m_buffer[i * RawSector];
+         const u8 *data = cur + (cur[15] == 1 ? 16 : 24);
+
+         u32 n = min<u32>(UserData - skip, len);
+         memcpy(dest, data + skip, n);
+
+         dest += n, len -= n, skip = 0;
+      }
+
+      sector += count;
+   }
+}
+
+/**
+* Tells whether a file is a disc image, based on its extension.
+* @param fileName Path to the file.
+* @return True for .bin and .iso files, false otherwise.
+*/
+bool DiscImage::isDiscImage (const string &fileName)
+{
+   return boost::iends_with(fileName, ".bin") || boost::iends_with(fileName, ".iso");
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef DISCIMAGE_HPP
+#define DISCIMAGE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "common.hpp"
+
+/**
+* Reads data from the IMG file, either from the IMG itself or straight from
+* the image of the disc holding it. Disc images can have 2048-byte sectors
+* (.iso) or raw 2352-byte sectors (.bin), in which case the sync, header and
+* error correction bytes of each sector are stripped while reading.
+*/
+class DiscImage
+{
+public:
+   /**
+   * Opens the file, finding out its type from the extension and contents.
+   * @param fileName Path to the IMG file or disc image.
+   * @param discSector Sector position of the IMG file inside the disc image.
+   * @param secSize Size of each sector (in bytes).
+   */
+   DiscImage (const std::string &fileName, u32 discSector, u16 secSize);
+
+   /**
+   * Reads data from the IMG file.
+   * @param offset Offset inside the IMG file.
+   * @param dest Where the data will be stored.
+   * @param len Length of the data (in bytes).
+   */
+   void read (u32 offset, u8 *dest, u32 len);
+
+   /**
+   * Tells whether a file is a disc image, based on its extension.
+   * @param fileName Path to the file.
+   * @return True for .bin and .iso files, false otherwise.
+   */
+   static bool isDiscImage (const std::string &fileName);
+
+   int type () const { return m_type; }
+
+   enum {
+      Img,    /**< The IMG file itself                 */
+      Cooked, /**< Disc image with 2048-byte sectors   */
+      Raw     /**< Disc image with 2352-byte sectors   */
+   };
+
+   enum {
+      UserData = 2048,   /**< Data bytes in each sector                */
+      RawSector = 2352,  /**< Length of each sector in raw disc images */
+      BatchSectors = 64  /**< Raw sectors read at once                 */
+   };
+
+private:
+   std::ifstream m_file;     /**< IMG file or disc image.                  */
+   std::string m_fileName;   /**< Path to the file.                        */
+   int m_type;               /**< Type of the file.                        */
+   u32 m_discSector;         /**< Sector position of the IMG in the disc.  */
+   std::vector<u8> m_buffer; /**< Raw sectors being de-framed.             */
+};
+
+#endif //~DISCIMAGE_HPP
\ No newline at end of file
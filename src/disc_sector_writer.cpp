@@ -0,0 +1,321 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "disc_sector_writer.hpp"
+#include "disc_image.hpp"
+#include "parallel.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <boost/bind.hpp>
+
+using namespace std;
+
+/**
+* Lookup tables used to calculate the EDC and ECC of the sectors.
+* The EDC table is split in four, so four bytes are handled at once.
+*/
+static struct tagFF8EccTables
+{
+   tagFF8EccTables ()
+   {
+      for (u32 i = 0; i < 256; i++)
+      {
+         u32 j = (i << 1) ^ (i & 0x80 ? 0x11d : 0);
+         fwd[i] = static_cast<u8>(j);
+         back[i ^ j] = static_cast<u8>(i);
+
+         u32 edc = i;
+         for (int k = 0; k < 8; k++) edc = (edc >> 1) ^ (edc & 1 ? 0xd8018001 : 0);
+         edc0[i] = edc;
+      }
+
+      for (u32 i = 0; i < 256; i++)
+      {
+         edc1[i] = (edc0[i] >> 8) ^ edc0[edc0[i] & 0xff];
+         edc2[i] = (edc1[i] >> 8) ^ edc0[edc1[i] & 0xff];
+         edc3[i] = (edc2[i] >> 8) ^ edc0[edc2[i] & 0xff];
+      }
+   }
+
+   u8 fwd[256], back[256];
+   u32 edc0[256], edc1[256], edc2[256], edc3[256];
+} tables;
+
+/**
+* Calculates the EDC (a CRC32 variant) of a block of data.
+* @param data The data to be checked.
+* @param len Length of the data (in bytes).
+* @return The EDC.
+*/
+static u32 edcCompute (const u8 *data, u32 len)
+{
+   u32 edc = 0;
+
+   for (; len >= 4; len -= 4, data += 4)
+   {
+      edc ^= data[0] | data[1] << 8 | data[2] << 16 | static_cast<u32>(data[3]) << 24;
+      edc = tables.edc3[edc & 0xff] ^ tables.edc2[(edc >> 8) & 0xff] ^ tables.edc1[(edc >> 16) & 0xff] ^ tables.edc0[(edc >> 24) & 0xff];
+   }
+
+   while (len--)
+      edc = (edc >> 8) ^ tables.edc0[(edc ^ *data++) & 0xff];
+
+   return edc;
+}
+
+/**
+* Stores an EDC in little-endian order.
+* @param edc The EDC.
+* @param dest Where the EDC will be stored.
+*/
+static void storeEdc (u32 edc, u8 *dest)
+{
+   for (int i = 0; i < 4; i++)
+      dest[i] = static_cast<u8>(edc >> i * 8);
+}
+
+/**
+* Calculates one of the Reed-Solomon parity blocks (P or Q) of a sector.
+* @param src Start of the protected area (the sector header).
+* @param majorCount Number of parity byte pairs.
+* @param minorCount Number of bytes protected by each pair.
+* @param majorMult Distance between the areas protected by each pair.
+* @param minorInc Distance between the bytes protected by a pair.
+* @param dest Where the parity bytes will be stored.
+*/
+static void eccCompute (const u8 *src, u32 majorCount, u32 minorCount, u32 majorMult, u32 minorInc, u8 *dest)
+{
+   u32 size = majorCount * minorCount;
+
+   for (u32 major = 0; major < majorCount; major++)
+   {
+      u32 index = (major >> 1) * majorMult + (major & 1);
+      u8 eccA = 0, eccB = 0;
+
+      for (u32 minor = 0; minor < minorCount; minor++)
+      {
+         u8 cur = src[index];
+         index += minorInc;
+         if (index >= size) index -= size;
+
+         eccA = tables.fwd[eccA ^ cur];
+         eccB ^= cur;
+      }
+
+      eccA = tables.back[tables.fwd[eccA] ^ eccB];
+      dest[major] = eccA;
+      dest[major + majorCount] = eccA ^ eccB;
+   }
+}
+
+/**
+* @param disc The disc image, opened for reading and writing.
+* @param snapshot Journal where the overwritten sectors are saved.
+* @param discSector Sector position of the IMG file inside the disc image.
+*/
+DiscSectorWriter::DiscSectorWriter (fstream &disc, ImgSnapshot &snapshot, u32 discSector) :
+   m_disc(disc), m_snapshot(snapshot), m_discSector(discSector)
+{
+}
+
+/**
+* Reads data from the IMG file, including data not flushed yet.
+* @param offset Offset inside the IMG file.
+* @param dest Where the data will be stored.
+* @param len Length of the data (in bytes).
+*/
+void DiscSectorWriter::read (u32 offset, u8 *dest, u32 len)
+{
+   u32 sector = m_discSector + offset / DiscImage::UserData, skip = offset % DiscImage::UserData;
+
+   vector<u8> buffer(DiscImage::RawSector);
+
+   for (; len; sector++, skip = 0)
+   {
+      sectormap_type::iterator i = m_dirty.find(sector);
+      const u8 *cur = i != m_dirty.end() ? &i->second[0] : &buffer[0];
+
+      if (i == m_dirty.end())
+      {
+         m_disc.seekg(static_cast<streamoff>(sector) * DiscImage::RawSector);
+         m_disc.read((char *)&buffer[0], DiscImage::RawSector);
+
+         if (m_disc.gcount() != DiscImage::RawSector)
+         {
+            m_disc.clear();
+            throw exception("Unexpected end of disc image.");
+         }
+      }
+
+      u32 n = min<u32>(DiscImage::UserData - skip, len);
+      memcpy(dest, cur + (cur[15] == 1 ? 16 : 24) + skip, n);
+      dest += n, len -= n;
+   }
+}
+
+/**
+* Writes data into the IMG file. The data only reaches the disc image
+* when flushed, which happens automatically when too many are pending.
+* @param offset Offset inside the IMG file.
+* @param data Data to be written.
+* @param len Length of the data (in bytes).
+*/
+void DiscSectorWriter::write (u32 offset, const u8 *data, u32 len)
+{
+   u32 sector = m_discSector + offset / DiscImage::UserData, skip = offset % DiscImage::UserData;
+
+   for (; len; sector++, skip = 0)
+   {
+      if (m_dirty.size() >= MaxPending) flush();
+
+      u8 *cur = loadSector(sector);
+      u32 n = min<u32>(DiscImage::UserData - skip, len);
+
+      // form 2 sectors (used by movies and audio) have a different layout
+      if (cur[15] == 2 && cur[18] & 0x20)
+         throw exception("Can't write IMG data into a mode 2 form 2 sector.");
+
+      memcpy(cur + (cur[15] == 1 ? 16 : 24) + skip, data, n);
+      data += n, len -= n;
+   }
+}
+
+/**
+* Regenerates the EDC and ECC of every modified sector and writes them.
+* Each thread encodes its own share of the sectors, then every run of
+* consecutive sectors is saved in the journal and written back at once.
+* @return Number of sectors written.
+*/
+u32 DiscSectorWriter::flush ()
+{
+   if (m_dirty.empty()) return 0;
+
+   vector<u8 *> pending;
+   for (sectormap_type::iterator i = m_dirty.begin(); i != m_dirty.end(); ++i)
+      pending.push_back(&i->second[0]);
+
+   Parallel::run(static_cast<u32>(pending.size()), boost::bind(&DiscSectorWriter::encodeRange, &pending[0], _1, _2));
+
+   vector<char> run;
+
+   for (sectormap_type::iterator i = m_dirty.begin(); i != m_dirty.end(); )
+   {
+      u32 start = i->first, count = 0;
+      run.clear();
+
+      for (; i != m_dirty.end() && i->first == start + count; ++i, count++)
+         run.insert(run.end(), i->second.begin(), i->second.end());
+
+      streamoff pos = static_cast<streamoff>(start) * DiscImage::RawSector;
+      m_snapshot.record(m_disc, static_cast<u32>(pos), static_cast<u32>(run.size()));
+
+      m_disc.seekp(pos);
+      m_disc.write(&run[0], run.size());
+   }
+
+   u32 written = static_cast<u32>(m_dirty.size());
+   m_dirty.clear();
+
+   return written;
+}
+
+/**
+* Tells whether a disc image has raw sectors.
+* @param disc The disc image.
+* @return True if the image starts with a sync pattern.
+*/
+bool DiscSectorWriter::isRaw (istream &disc)
+{
+   const u8 sync[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+   u8 head[sizeof(sync)] = { 0xff };
+
+   disc.seekg(0);
+   disc.read((char *)head, sizeof(head));
+   disc.clear();
+
+   return equal(head, head + sizeof(head), sync);
+}
+
+/**
+* Regenerates the EDC and ECC of a mode 1 or mode 2 form 1 sector.
+* In mode 2 sectors, the header isn't protected by the ECC, so it's
+* handled as if it was filled with 0x00.
+* @param sector The raw sector.
+*/
+void DiscSectorWriter::encodeSector (u8 *sector)
+{
+   u8 header[4];
+   bool mode1 = sector[15] == 1;
+
+   if (mode1)
+   {
+      storeEdc(edcCompute(sector, 0x810), sector + 0x810);
+      fill(sector + 0x814, sector + 0x81c, 0x00);
+   }
+   else
+   {
+      storeEdc(edcCompute(sector + 0x10, 0x808), sector + 0x818);
+      copy(sector + 0x0c, sector + 0x10, header);
+      fill(sector + 0x0c, sector + 0x10, 0x00);
+   }
+
+   eccCompute(sector + 0x0c, 86, 24, 2, 86, sector + 0x81c);
+   eccCompute(sector + 0x0c, 52, 43, 86, 88, sector + 0x8c8);
+
+   if (!mode1) copy(header, header + 4, sector + 0x0c);
+}
+
+/**
+* Loads a sector into the list of modified sectors.
+* @param sector Position of the sector in the disc image.
+* @return Pointer to the raw sector.
+*/
+u8 *DiscSectorWriter::loadSector (u32 sector)
+{
+   sectormap_type::iterator i = m_dirty.find(sector);
+   if (i != m_dirty.end()) return &i->second[0];
+
+   vector<u8> &cur = m_dirty[sector];
+   cur.resize(DiscImage::RawSector);
+
+   m_disc.seekg(static_cast<streamoff>(sector) * DiscImage::RawSector);
+   m_disc.read((char *)&cur[0], DiscImage::RawSector);
+
+   if (m_disc.gcount() != DiscImage::RawSector)
+   {
+      m_dirty.erase(sector);
+      m_disc.clear();
+      throw exception("Unexpected end of disc image.");
+   }
+
+   return &cur[0];
+}
+
+/**
+* Regenerates the EDC and ECC of a share of the sectors.
+* @param sectors The sectors.
+* @param first First sector of the share.
+* @param last Sector after the last one.
+*/
+void DiscSectorWriter::encodeRange (u8 **sectors, u32 first, u32 last)
+{
+   for (u32 i = first; i < last; i++)
+      encodeSector(sectors[i]);
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef DISCSECTORWRITER_HPP
+#define DISCSECTORWRITER_HPP
+
+#include <map>
+#include <vector>
+#include <fstream>
+#include "common.hpp"
+#include "img_snapshot.hpp"
+
+/**
+* Writes IMG data into a disc image with raw 2352-byte sectors. Modified
+* sectors are kept in memory and, when flushed, get their EDC and ECC
+* regenerated by several threads before being written back at once.
+*/
+class DiscSectorWriter
+{
+public:
+   /**
+   * @param disc The disc image, opened for reading and writing.
+   * @param snapshot Journal where the overwritten sectors are saved.
+   * @param discSector Sector position of the IMG file inside the disc image.
+   */
+   DiscSectorWriter (std::fstream &disc, ImgSnapshot &snapshot, u32 discSector);
+
+   /**
+   * Reads data from the IMG file, including data not flushed yet.
+   * @param offset Offset inside the IMG file.
+   * @param dest Where the data will be stored.
+   * @param len Length of the data (in bytes).
+   */
+   void read (u32 offset, u8 *dest, u32 len);
+
+   /**
+   * Writes data into the IMG file. The data only reaches the disc image
+   * when flushed, which happens automatically when too many are pending.
+   * @param offset Offset inside the IMG file.
+   * @param data Data to be written.
+   * @param len Length of the data (in bytes).
+   */
+   void write (u32 offset, const u8 *data, u32 len);
+
+   /**
+   * Regenerates the EDC and ECC of every modified sector and writes them.
+   * @return Number of sectors written.
+   */
+   u32 flush ();
+
+   /**
+   * Tells whether a disc image has raw sectors.
+   * @param disc The disc image.
+   * @return True if the image starts with a sync pattern.
+   */
+   static bool isRaw (std::istream &disc);
+
+   /**
+   * Regenerates the EDC and ECC of a mode 1 or mode 2 form 1 sector.
+   * @param sector The raw sector.
+   */
+   static void encodeSector (u8 *sector);
+
+   enum {
+      MaxPending = 8192 /**< Modified sectors kept before flushing */
+   };
+
+private:
+   typedef std::map<u32, std::vector<u8> > sectormap_type;
+
+   u8 *loadSector (u32 sector);
+   static void encodeRange (u8 **sectors, u32 first, u32 last);
+
+   std::fstream &m_disc;      /**< The disc image.                          */
+   ImgSnapshot &m_snapshot;   /**< Journal of the overwritten sectors.      */
+   u32 m_discSector;          /**< Sector position of the IMG in the disc.  */
+   sectormap_type m_dirty;    /**< Modified sectors, by position.           */
+};
+
+#endif //~DISCSECTORWRITER_HPP
\ No newline at end of file
@@ -0,0 +1,244 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "dte_optimizer.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <boost/bind.hpp>
+
+using namespace std;
+
+/** Marks a piece of text the table can't encode. */
+static const u32 Untranslatable = 0xffffffff;
+
+/** Line separating the blocks of a script (followed by a note on shared blocks). */
+static const string BlockSeparator(33, '-');
+
+/** Start of the line telling where a block was found, when written. */
+static const string RecordTag("@@ ");
+
+DteOptimizer::DteOptimizer (const Dictionary &dic) : m_original(dic), m_table(dic), m_skipped(0)
+{
+   for (u32 i = 0; i < 256; i++)
+      if (dic.find<u8>(static_cast<u8>(i)).size() == 2) m_codes.push_back(static_cast<u8>(i));
+}
+
+/**
+* Collects the text of a script. Codes, block separators, records and line
+* breaks are left out, since DTEs can't span them. Each distinct piece of
+* text is kept only once, along with the number of times it's used.
+* @param name Name of the script, used in the report.
+* @param script Content of the script.
+*/
+void DteOptimizer::addScript (const string &name, const string &script)
+{
+   const DictionaryTrie &trie = m_original.trie();
+   map<u32, u32> uses;
+   vector<u8> buffer;
+
+   for (string::size_type line = 0, eol; line < script.size(); line = eol + 1)
+   {
+      eol = min(script.find('\n', line), script.size());
+      if (script.compare(line, BlockSeparator.size(), BlockSeparator) == 0) continue;
+      if (script.compare(line, RecordTag.size(), RecordTag) == 0) continue;
+
+      for (string::size_type k = line, end; k < eol; k = end + 1)
+      {
+         end = min(script.find_first_of("[]", k), eol);
+
+         // whatever follows an opening bracket is a code
+         if (k > line && script[k - 1] == '[') continue;
+         if (end == k) continue;
+
+         string piece = script.substr(k, end - k);
+         map<string, u32>::iterator found = m_index.find(piece);
+
+         if (found == m_index.end())
+         {
+            u32 pos = static_cast<u32>(m_text.size());
+            buffer.resize(piece.size());
+
+            try {
+               trie.encode(piece.data(), piece.data() + piece.size(), &buffer[0], false);
+            }
+            catch (const exception &) {
+               pos = Untranslatable;
+            }
+
+            found = m_index.insert(make_pair(piece, pos)).first;
+
+            if (pos != Untranslatable)
+               m_text.push_back(piece), m_weight.push_back(0);
+         }
+
+         if (found->second == Untranslatable)
+         {
+            m_skipped++;
+            continue;
+         }
+
+         m_weight[found->second]++;
+         uses[found->second]++;
+      }
+   }
+
+   m_scripts.push_back(make_pair(name, uses_type(uses.begin(), uses.end())));
+}
+
+/**
+* Picks the DTE entries. Starting from a table without any, the text is
+* encoded and the pairs of characters still encoded one byte each are
+* counted; the most frequent pair takes the next DTE code. Counting again
+* after each pick keeps the pairs that overlap a chosen one from being
+* overrated.
+* @return Number of DTE entries assigned.
+*/
+u32 DteOptimizer::optimize ()
+{
+   m_table = m_original;
+
+   for (vector<u8>::iterator i = m_codes.begin(); i != m_codes.end(); ++i)
+      m_table.remove<u8>(*i);
+
+   // one set of counters for each share (at least one, even without any text)
+   u32 assigned = 0, count = static_cast<u32>(m_text.size()), threads = max<u32>(1, Parallel::numShares(count));
+   vector<u32> counts(threads * 0x10000);
+
+   for (; assigned < m_codes.size(); assigned++)
+   {
+      // compiled before the threads get to use it
+      m_table.trie();
+
+      fill(counts.begin(), counts.end(), 0);
+      Parallel::run(count, boost::bind(&DteOptimizer::countRange, this, _1, _2, _3, &m_table, &counts[0]));
+
+      for (u32 t = 1; t < threads; t++)
+         transform(counts.begin(), counts.begin() + 0x10000, counts.begin() + t * 0x10000, counts.begin(), plus<u32>());
+
+      u32 best = static_cast<u32>(max_element(counts.begin(), counts.begin() + 0x10000) - counts.begin());
+      if (!counts[best]) break;
+
+      string pair;
+      pair += static_cast<char>(best >> 8);
+      pair += static_cast<char>(best & 0xff);
+
+      m_table.insert<u8>(m_codes[assigned], pair);
+   }
+
+   return assigned;
+}
+
+/**
+* Compares the size of the text of each script with both tables.
+* @return The size of each script, in the order they were added.
+*/
+vector<DteOptimizer::ScriptSize> DteOptimizer::report () const
+{
+   vector<u32> before(m_text.size()), after(m_text.size());
+
+   m_original.trie(), m_table.trie();
+
+   if (!m_text.empty())
+   {
+      u32 count = static_cast<u32>(m_text.size());
+
+      Parallel::run(count, boost::bind(&DteOptimizer::sizeRange, this, _1, _2, _3, &m_original, &before[0]));
+      Parallel::run(count, boost::bind(&DteOptimizer::sizeRange, this, _1, _2, _3, &m_table, &after[0]));
+   }
+
+   vector<ScriptSize> result;
+
+   for (vector<pair<string, uses_type> >::const_iterator i = m_scripts.begin(); i != m_scripts.end(); ++i)
+   {
+      ScriptSize size = { i->first, 0, 0 };
+
+      for (uses_type::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+      {
+         size.before += before[j->first] * j->second;
+         size.after += after[j->first] * j->second;
+      }
+
+      result.push_back(size);
+   }
+
+   return result;
+}
+
+/**
+* Counts the pairs of characters encoded one byte each, for a share of the pieces of text.
+* @param first First piece of text.
+* @param last Piece of text after the last one.
+* @param share Number of the share, which selects the counters used.
+* @param dic The table used to encode the text.
+* @param counts Counters of every pair of characters, for each share.
+*/
+void DteOptimizer::countRange (u32 first, u32 last, u32 share, const Dictionary *dic, u32 *counts) const
+{
+   const DictionaryTrie &trie = dic->trie();
+   vector<u8> codes;
+   u8 length[256];
+
+   for (u32 i = 0; i < 256; i++)
+      length[i] = static_cast<u8>(dic->find<u8>(static_cast<u8>(i)).size());
+
+   counts += share * 0x10000;
+
+   for (u32 s = first; s < last; s++)
+   {
+      const string &text = m_text[s];
+      codes.resize(text.size());
+
+      u32 numCodes = trie.encode(text.data(), text.data() + text.size(), &codes[0]);
+      u32 covered = 0;
+
+      for (u32 i = 0, pos = 0; i + 1 < numCodes; pos += length[codes[i]], i++)
+      {
+         if (length[codes[i]] != 1 || length[codes[i + 1]] != 1) continue;
+
+         // in a run of the same character ("aaa"), the pairs can't overlap
+         if (pos < covered) continue;
+         if (text[pos] == text[pos + 1]) covered = pos + 2;
+
+         counts[static_cast<u8>(text[pos]) << 8 | static_cast<u8>(text[pos + 1])] += m_weight[s];
+      }
+   }
+}
+
+/**
+* Finds the encoded size of a share of the pieces of text.
+* @param first First piece of text.
+* @param last Piece of text after the last one.
+* @param share Number of the share (not used).
+* @param dic The table used to encode the text.
+* @param sizes Size of every piece of text.
+*/
+void DteOptimizer::sizeRange (u32 first, u32 last, u32, const Dictionary *dic, u32 *sizes) const
+{
+   const DictionaryTrie &trie = dic->trie();
+   vector<u8> codes;
+
+   for (u32 s = first; s < last; s++)
+   {
+      const string &text = m_text[s];
+      codes.resize(text.size());
+
+      sizes[s] = trie.encode(text.data(), text.data() + text.size(), &codes[0]);
+   }
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef DTEOPTIMIZER_HPP
+#define DTEOPTIMIZER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include "common.hpp"
+#include "dictionary.hpp"
+
+/**
+* Chooses the DTE entries of a table (the 8-bit entries holding two
+* characters) that best fit a set of scripts. The text of every script is
+* collected first, then the pair of characters that would save the most
+* bytes is picked over and over, until every DTE code is taken.
+*/
+class DteOptimizer
+{
+public:
+   /** Projected size of the text of a script */
+   typedef struct tagFF8DteScriptSize {
+      std::string name; /**< Name of the script.                     */
+      u32 before;       /**< Bytes used with the original table.     */
+      u32 after;        /**< Bytes used with the optimized table.    */
+   } ScriptSize;
+
+   /**
+   * @param dic The original table. The codes of its DTE entries are the
+   *            ones that will be reassigned.
+   */
+   explicit DteOptimizer (const Dictionary &dic);
+
+   /**
+   * Collects the text of a script. Codes, block separators and line breaks
+   * are left out, since DTEs can't span them.
+   * @param name Name of the script, used in the report.
+   * @param script Content of the script.
+   */
+   void addScript (const std::string &name, const std::string &script);
+
+   /**
+   * Picks the DTE entries, counting the pairs in several threads.
+   * @return Number of DTE entries assigned.
+   */
+   u32 optimize ();
+
+   /**
+   * Gets the optimized table (the original one until optimize is called).
+   * @return The table.
+   */
+   const Dictionary &table () const { return m_table; }
+
+   /**
+   * Compares the size of the text of each script with both tables.
+   * @return The size of each script, in the order they were added.
+   */
+   std::vector<ScriptSize> report () const;
+
+   /**
+   * Number of pieces of text left out because the table can't encode them.
+   * @return Number of pieces of text.
+   */
+   u32 skipped () const { return m_skipped; }
+
+private:
+   typedef std::vector<std::pair<u32, u32> > uses_type;
+
+   void countRange (u32 first, u32 last, u32 share, const Dictionary *dic, u32 *counts) const;
+   void sizeRange (u32 first, u32 last, u32 share, const Dictionary *dic, u32 *sizes) const;
+
+   const Dictionary &m_original;   /**< The original table.                       */
+   Dictionary m_table;             /**< The optimized table.                      */
+   std::vector<u8> m_codes;        /**< Codes available for DTE entries.          */
+   u32 m_skipped;                  /**< Pieces of text the table can't encode.    */
+
+   std::map<std::string, u32> m_index;            /**< Position of each piece of text.     */
+   std::vector<std::string> m_text;               /**< Every distinct piece of text.       */
+   std::vector<u32> m_weight;                     /**< Occurrences of each piece of text.  */
+   std::vector<std::pair<std::string, uses_type> > m_scripts; /**< Pieces used by each script. */
+};
+
+#endif //~DTEOPTIMIZER_HPP
\ No newline at end of file
@@ -40,8 +40,7 @@ bool FileExtractor::extractNextFieldFile (filedata_type &result, string &hint)
       boost::shared_array<u8> buffer(new u8[m_last->length]);
       u8 *bufferPtr = buffer.get();
                
-      m_img.seekg(m_last->offset);
-      m_img.read((char *)bufferPtr, m_last->length);
+      m_img.read(m_last->offset, bufferPtr, m_last->length);
 
       u32 *lzLen = (u32 *)bufferPtr;
 
@@ -100,8 +99,7 @@ bool FileExtractor::extractNextBattleFile (filedata_type &result, string &hint)
       boost::shared_array<u8> buffer(new u8[m_last->length]);
       u8 *bufferPtr = buffer.get();
                
-      m_img.seekg(m_last->offset);
-      m_img.read((char *)bufferPtr, m_last->length);
+      m_img.read(m_last->offset, bufferPtr, m_last->length);
 
       // field battle files without any text
       // TODO Extract files without text too, to create the bestiary.xml
@@ -112,15 +110,17 @@ bool FileExtractor::extractNextBattleFile (filedata_type &result, string &hint)
       u8 *nameIdPtr = bufferPtr + *infoPtr;
 
       int sz = count_if(nameIdPtr, nameIdPtr + 24, bind2nd(not_equal_to<u8>(), 0x00));
+      const DictionaryView &view = tbl.view();
       string name;
 
       // extract a nice name
       for (int i=0; i < sz; i++)
       {
-         if (nameIdPtr[i] == 0x03 || nameIdPtr[i] == 0x0c)
-            name += tbl.find<u16>((nameIdPtr[i] << 8) | (nameIdPtr[i + 1] & 0xff)), i++;
-         else
-            name += tbl.find<u8>(nameIdPtr[i]);
+         const DictionaryView::Fragment &r = (nameIdPtr[i] == 0x03 || nameIdPtr[i] == 0x0c) ?
+            view.rawMte(nameIdPtr[i], nameIdPtr[i + 1]) : view.rawByte(nameIdPtr[i]);
+
+         name.append(r.text, r.length);
+         if (nameIdPtr[i] == 0x03 || nameIdPtr[i] == 0x0c) i++;
       }
 
       // make it looks even nicer
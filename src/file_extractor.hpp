@@ -28,22 +28,20 @@
 #include "common.hpp"
 #include "extractinfo.hpp"
 #include "dictionary.hpp"
+#include "disc_image.hpp"
 
 /**
 * The purpose of this class is to extract data from an IMG file
-* based on information described inside a XML file.
+* based on information described inside a XML file. The IMG file
+* can also be read straight from a disc image (.bin or .iso).
 */
 class FileExtractor
 {
 public:
-   FileExtractor (FF8ExtractInfo &info, std::string battleDic) : m_info(info)
+   FileExtractor (FF8ExtractInfo &info, std::string battleDic) :
+      m_img(info.imgName(), info.indexSector(), info.secSize()), m_info(info)
    {
-      m_img.open(m_info.imgName(), std::ios::binary);
-
-      std::string error = "Failed to open " + m_info.imgName() + " file.";
-      if (!m_img) throw std::exception(error.c_str());
-
-      tbl.loadFromFile(battleDic);
+      tbl.loadFromFile(battleDic, true);
    }
 
    typedef std::pair<boost::shared_array<u8>, u32> filedata_type;
@@ -61,23 +59,23 @@ public:
    */
    u32 loadMainIndex ()
    {
-      m_img.seekg(m_info.indexOffset());
+      // the index is read a sector at a time, disc images are slower to read
+      std::vector<IndexEntry> entries(m_info.secSize() / sizeof(IndexEntry));
+      u32 offset = m_info.indexOffset();
 
-      for (u16 i=0; ; i++)
+      for (;;)
       {
-         IndexEntry temp;
-         m_img.read((char *)&temp, sizeof(temp));
-
-         if (temp.isInvalid())
-            break;
+         m_img.read(offset, (u8 *)&entries[0], m_info.secSize());
 
-         temp.offset -= m_info.indexSector();
-         temp.offset *= m_info.secSize();
+         for (std::vector<IndexEntry>::iterator i = entries.begin(); i != entries.end(); ++i, offset += sizeof(IndexEntry))
+         {
+            if (i->isInvalid())
+               return offset;
 
-         m_records.push_back(temp);
+            IndexEntry temp((i->offset - m_info.indexSector()) * m_info.secSize(), i->length);
+            m_records.push_back(temp);
+         }
       }
-
-      return static_cast<u32>(m_img.tellg()) - sizeof(IndexEntry);
    }
 
    /**
@@ -90,10 +88,8 @@ public:
       if (m_records.empty())
          throw std::exception("FileExtractor::loadMainIndex should be called before extracting any files.");
 
-      m_img.seekg(m_records[id].offset);
-      
       boost::shared_array<u8> data(new u8[m_records[id].length]);
-      m_img.read((char *)data.get(), m_records[id].length);
+      m_img.read(m_records[id].offset, data.get(), m_records[id].length);
 
       // updates information about the file
       m_info[id].offset(m_records[id].offset), m_info[id].length(m_records[id].length);
@@ -198,7 +194,7 @@ private:
    std::vector<IndexEntry>::iterator m_last; /**< Iterative extraction iterator. */
 
    Dictionary tbl;         /**< Dictionary to collect field battle info. */
-   std::ifstream m_img;    /**< .IMG file */
+   DiscImage m_img;        /**< .IMG file (or disc image) */
    FF8ExtractInfo &m_info; /**< Info from extractdata.xml */
 };
 
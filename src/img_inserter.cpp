@@ -0,0 +1,298 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "img_inserter.hpp"
+#include "lzsencoder.hpp"
+#include "disc_image.hpp"
+
+#include <set>
+#include <algorithm>
+#include <exception>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+using boost::shared_array;
+
+/**
+* Creates the output IMG as a snapshot of the original one. Every area
+* overwritten afterwards is saved in the undo journal of the snapshot.
+* When the IMG is inside a disc image, the files have to fit in its
+* original sectors, since whatever follows it can't be moved.
+* @param originalImg Path to the original IMG file.
+* @param outputImg Path where the new IMG file will be created.
+* @param secSize Size of each sector (in bytes).
+* @param discSector Sector position of the IMG file inside the disc image.
+*/
+ImgInserter::ImgInserter (const string &originalImg, const string &outputImg, u16 secSize, u32 discSector) :
+   m_imgName(outputImg), m_secSize(secSize), m_discSector(discSector), m_indexStart(0), m_base(0), m_imgEnd(0), m_disc(DiscImage::isDiscImage(outputImg))
+{
+   if (m_disc && secSize != DiscImage::UserData)
+      throw exception(("Unexpected sector size for disc image " + outputImg).c_str());
+
+   m_snapshot.reset(new ImgSnapshot(originalImg, outputImg));
+
+   m_img.open(outputImg.c_str(), ios::in | ios::out | ios::binary);
+   if (!m_img) throw exception(("Failed to open " + outputImg + " file.").c_str());
+
+   m_img.exceptions(ios_base::badbit);
+
+   if (m_disc)
+   {
+      if (DiscSectorWriter::isRaw(m_img))
+         m_sectors.reset(new DiscSectorWriter(m_img, *m_snapshot, discSector));
+      else
+         m_base = discSector * secSize;
+   }
+
+   // the length of an IMG inside a disc image is found out from its index
+   u32 imgLen = m_disc ? 0 : static_cast<u32>(boost::filesystem::file_size(outputImg));
+   m_planner.reset(new LayoutPlanner(secSize, discSector, imgLen));
+}
+
+/**
+* Loads the main index found in the IMG file.
+* @param start Offset of the first index entry.
+* @param end Offset of the index terminator.
+*/
+void ImgInserter::loadMainIndex (u32 start, u32 end)
+{
+   shared_array<u8> entries(new u8[end - start]);
+   read(start, entries.get(), end - start);
+
+   m_planner->loadIndex("", entries.get(), (end - start) / 8, start);
+   trackEnd(entries.get(), (end - start) / 8);
+
+   // the index itself (and its terminator) must never be overwritten
+   m_planner->reserve(start, end - start + 8);
+   m_indexStart = start;
+}
+
+/**
+* Loads a sub-index, so the files it references can be inserted too.
+* @param indexFile Name of the file holding the sub-index.
+* @param indexId Id of that file in the main index.
+* @param data Contents of the file (already decompressed).
+* @param start Offset of the first sub-index entry.
+* @param end Offset where the sub-index ends.
+* @param compressed Whether the file must be lzs-compressed when stored.
+*/
+void ImgInserter::loadSubIndex (const string &indexFile, u16 indexId, const filedata_type &data, u32 start, u32 end, bool compressed)
+{
+   SubIndex sub = { data, indexId, start, compressed };
+   m_subIndices[indexFile] = sub;
+
+   m_planner->loadIndex(indexFile, data.first.get() + start, (end - start) / 8, start);
+   trackEnd(data.first.get() + start, (end - start) / 8);
+}
+
+/**
+* Queues a file to be inserted.
+* @param indexFile File holding the index which refers to it (empty for the main index).
+* @param id Position of the file in its index.
+* @param data The new contents of the file.
+*/
+void ImgInserter::add (const string &indexFile, u16 id, const filedata_type &data)
+{
+   if (indexFile.empty())
+   {
+      m_mainQueue[make_pair(indexFile, m_indexStart + id * 8)] = data;
+      return;
+   }
+
+   map<string, SubIndex>::iterator sub = m_subIndices.find(indexFile);
+
+   if (sub == m_subIndices.end())
+      throw exception(("The sub-index from " + indexFile + " should be loaded before inserting its files.").c_str());
+
+   m_subQueue[make_pair(indexFile, sub->second.start + id * 8)] = data;
+}
+
+/**
+* Plans the new layout and writes every queued file and index entry.
+* Files from sub-indices are inserted first, since the files holding
+* their indices have to be rebuilt and inserted as well. If anything goes
+* wrong, the output IMG is rolled back to its original contents.
+* @return Where each inserted file was placed.
+*/
+vector<LayoutPlanner::Move> ImgInserter::commit ()
+{
+   try
+   {
+      vector<LayoutPlanner::Move> moves = commitQueued();
+      m_snapshot->discard();
+
+      return moves;
+   }
+   catch (...)
+   {
+      if (m_img.is_open()) m_img.close();
+      m_snapshot->rollback();
+
+      throw;
+   }
+}
+
+/**
+* Writes every queued file and index entry.
+* @return Where each inserted file was placed.
+*/
+vector<LayoutPlanner::Move> ImgInserter::commitQueued ()
+{
+   vector<LayoutPlanner::Move> moves = insertQueued(m_subQueue);
+   set<string> touched;
+
+   // updates the sub-indices
+   for (vector<LayoutPlanner::Move>::iterator i = moves.begin(); i != moves.end(); ++i)
+   {
+      SubIndex &sub = m_subIndices[i->entry.first];
+      m_planner->encodeEntry(*i, sub.data.first.get() + i->entry.second);
+
+      touched.insert(i->entry.first);
+   }
+
+   // the files holding the updated sub-indices go back into the main index
+   for (set<string>::iterator i = touched.begin(); i != touched.end(); ++i)
+   {
+      SubIndex &sub = m_subIndices[*i];
+
+      if (sub.compressed)
+      {
+         LZSEncoder encoder(sub.data);
+         LZSEncoder::filedata_type encData = encoder.encode();
+
+         shared_array<u8> buffer(new u8[encData.second + 4]);
+         *((u32 *)buffer.get()) = encData.second;
+         copy(encData.first.get(), encData.first.get() + encData.second, buffer.get() + 4);
+
+         add("", sub.id, make_pair(buffer, encData.second + 4));
+      }
+      else add("", sub.id, sub.data);
+   }
+
+   vector<LayoutPlanner::Move> mainMoves = insertQueued(m_mainQueue);
+
+   // updates the main index
+   for (vector<LayoutPlanner::Move>::iterator i = mainMoves.begin(); i != mainMoves.end(); ++i)
+   {
+      u8 entry[8];
+      m_planner->encodeEntry(*i, entry);
+
+      write(i->entry.second, entry, sizeof(entry), false);
+   }
+
+   moves.insert(moves.end(), mainMoves.begin(), mainMoves.end());
+
+   if (m_sectors) m_sectors->flush();
+   m_img.close();
+
+   // files moved away from the end of the IMG leave free sectors behind
+   if (!m_disc && m_planner->imageLength() < boost::filesystem::file_size(m_imgName))
+      boost::filesystem::resize_file(m_imgName, m_planner->imageLength());
+
+   return moves;
+}
+
+/**
+* Plans the position of the files in the given queue and writes them.
+* @param queue Files to be inserted, by index entry.
+* @return Where each file was placed.
+*/
+vector<LayoutPlanner::Move> ImgInserter::insertQueued (queue_type &queue)
+{
+   for (queue_type::iterator i = queue.begin(); i != queue.end(); ++i)
+      m_planner->request(i->first, i->second.second);
+
+   vector<LayoutPlanner::Move> moves = m_planner->plan();
+
+   for (vector<LayoutPlanner::Move>::iterator i = moves.begin(); i != moves.end(); ++i)
+   {
+      // whatever follows the IMG inside a disc image can't be overwritten
+      if (m_disc && i->newOffset + i->newLength > m_imgEnd)
+         throw exception("There's not enough free space inside the IMG of the disc image.");
+
+      filedata_type &data = queue[i->entry];
+      write(i->newOffset, data.first.get(), data.second);
+   }
+
+   queue.clear();
+   return moves;
+}
+
+/**
+* Writes data into the output IMG, saving the overwritten area in the journal first.
+* @param offset Offset inside the IMG.
+* @param data Data to be written.
+* @param len Length of the data (in bytes).
+* @param pad Whether the rest of the last sector should be filled with 0x00.
+*/
+void ImgInserter::write (u32 offset, const u8 *data, u32 len, bool pad)
+{
+   vector<char> padding(pad ? (m_secSize - len % m_secSize) % m_secSize : 0, 0x00);
+
+   // raw sectors are journaled when flushed, along with their new EDC/ECC
+   if (m_sectors)
+   {
+      m_sectors->write(offset, data, len);
+      if (!padding.empty()) m_sectors->write(offset + len, (const u8 *)&padding[0], static_cast<u32>(padding.size()));
+
+      return;
+   }
+
+   m_snapshot->record(m_img, m_base + offset, len + static_cast<u32>(padding.size()));
+
+   m_img.seekp(m_base + offset);
+   m_img.write((const char *)data, len);
+
+   if (!padding.empty()) m_img.write(&padding[0], padding.size());
+}
+
+/**
+* Updates the end of the IMG, as far as the index entries can tell.
+* @param entries Pointer to the first index entry.
+* @param count Number of entries.
+*/
+void ImgInserter::trackEnd (const u8 *entries, u32 count)
+{
+   const u32 *cur = (const u32 *)entries;
+
+   for (u32 i = 0; i < count; i++, cur += 2)
+   {
+      if (cur[0] < m_discSector || !cur[1]) continue;
+
+      u32 end = (cur[0] - m_discSector) * m_secSize + cur[1];
+      m_imgEnd = max(m_imgEnd, (end + m_secSize - 1) / m_secSize * m_secSize);
+   }
+}
+
+/**
+* Reads data from the output IMG.
+* @param offset Offset inside the IMG.
+* @param dest Where the data will be stored.
+* @param len Length of the data (in bytes).
+*/
+void ImgInserter::read (u32 offset, u8 *dest, u32 len)
+{
+   if (m_sectors)
+   {
+      m_sectors->read(offset, dest, len);
+      return;
+   }
+
+   m_img.seekg(m_base + offset);
+   m_img.read((char *)dest, len);
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef IMGINSERTER_HPP
+#define IMGINSERTER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <utility>
+#include <boost/shared_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "common.hpp"
+#include "layout_planner.hpp"
+#include "img_snapshot.hpp"
+#include "disc_sector_writer.hpp"
+
+/**
+* Inserts rebuilt files back into a snapshot of the IMG file, relocating the ones
+* that outgrew their original sectors and updating every affected index entry.
+* The IMG can also be written straight into a disc image (.bin or .iso).
+*/
+class ImgInserter
+{
+public:
+   /** Used to represent a binary data block */
+   typedef std::pair<boost::shared_array<u8>, u32> filedata_type;
+
+   /**
+   * Creates the output IMG as a snapshot of the original one.
+   * @param originalImg Path to the original IMG file.
+   * @param outputImg Path where the new IMG file will be created.
+   * @param secSize Size of each sector (in bytes).
+   * @param discSector Sector position of the IMG file inside the disc image.
+   */
+   ImgInserter (const std::string &originalImg, const std::string &outputImg, u16 secSize, u32 discSector);
+
+   /**
+   * Loads the main index found in the IMG file.
+   * @param start Offset of the first index entry.
+   * @param end Offset of the index terminator.
+   */
+   void loadMainIndex (u32 start, u32 end);
+
+   /**
+   * Loads a sub-index, so the files it references can be inserted too.
+   * @param indexFile Name of the file holding the sub-index.
+   * @param indexId Id of that file in the main index.
+   * @param data Contents of the file (already decompressed).
+   * @param start Offset of the first sub-index entry.
+   * @param end Offset where the sub-index ends.
+   * @param compressed Whether the file must be lzs-compressed when stored.
+   */
+   void loadSubIndex (const std::string &indexFile, u16 indexId, const filedata_type &data, u32 start, u32 end, bool compressed);
+
+   /**
+   * Queues a file to be inserted.
+   * @param indexFile File holding the index which refers to it (empty for the main index).
+   * @param id Position of the file in its index.
+   * @param data The new contents of the file.
+   */
+   void add (const std::string &indexFile, u16 id, const filedata_type &data);
+
+   /**
+   * Plans the new layout and writes every queued file and index entry.
+   * The output IMG is rolled back to its original contents on failure.
+   * @return Where each inserted file was placed.
+   */
+   std::vector<LayoutPlanner::Move> commit ();
+
+   /**
+   * Tells whether the output IMG shares its data with the original one.
+   * @return True if the output IMG was cloned, false if it was copied.
+   */
+   bool cloned () const { return m_snapshot->cloned(); }
+
+private:
+   typedef struct tagFF8SubIndex {
+      filedata_type data; /**< Decompressed index file.             */
+      u16 id;             /**< Id of the index file in main index.  */
+      u32 start;          /**< Offset of the first entry.           */
+      bool compressed;    /**< The index file is lzs-compressed.    */
+   } SubIndex;
+
+   typedef std::map<LayoutPlanner::entryref_type, filedata_type> queue_type;
+
+   std::vector<LayoutPlanner::Move> commitQueued ();
+   std::vector<LayoutPlanner::Move> insertQueued (queue_type &queue);
+   void write (u32 offset, const u8 *data, u32 len, bool pad = true);
+   void read (u32 offset, u8 *dest, u32 len);
+   void trackEnd (const u8 *entries, u32 count);
+
+   std::string m_imgName;  /**< Path to the output IMG.                */
+   std::fstream m_img;     /**< Output IMG file.                       */
+   u16 m_secSize;          /**< Size of each sector (in bytes).        */
+   u32 m_discSector;       /**< Sector position in the disc image.     */
+   u32 m_indexStart;       /**< Offset of the main index.              */
+   u32 m_base;             /**< Offset of the IMG inside the file.     */
+   u32 m_imgEnd;           /**< End of the last file in the IMG.       */
+   bool m_disc;            /**< The output is a disc image.            */
+
+   boost::scoped_ptr<ImgSnapshot> m_snapshot;     /**< Undo journal of the output.   */
+   boost::scoped_ptr<DiscSectorWriter> m_sectors; /**< Raw sectors of a .bin output. */
+   boost::scoped_ptr<LayoutPlanner> m_planner;    /**< Decides where files go.       */
+   std::map<std::string, SubIndex> m_subIndices;  /**< Sub-indices by file name.     */
+   queue_type m_mainQueue;                        /**< Files from the main index.    */
+   queue_type m_subQueue;                         /**< Files from the sub-indices.   */
+};
+
+#endif //~IMGINSERTER_HPP
\ No newline at end of file
@@ -0,0 +1,264 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "img_snapshot.hpp"
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <boost/filesystem.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+
+// block cloning (ReFS) is missing from older SDKs
+#ifndef FSCTL_DUPLICATE_EXTENTS_TO_FILE
+#define FSCTL_DUPLICATE_EXTENTS_TO_FILE CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 209, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+typedef struct _DUPLICATE_EXTENTS_DATA {
+   HANDLE FileHandle;
+   LARGE_INTEGER SourceFileOffset;
+   LARGE_INTEGER TargetFileOffset;
+   LARGE_INTEGER ByteCount;
+} DUPLICATE_EXTENTS_DATA;
+#endif
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
+using namespace std;
+
+/** Size of the blocks checked by the sparse copy. */
+static const u32 CopyBlock = 0x10000;
+
+/**
+* Creates the snapshot and starts a new journal. The journal starts with
+* the length of the snapshot, so the IMG can be shrunk back on rollback.
+* @param originalImg Path to the original IMG file.
+* @param outputImg Path where the snapshot will be created.
+*/
+ImgSnapshot::ImgSnapshot (const string &originalImg, const string &outputImg) :
+   m_imgName(outputImg), m_journalName(outputImg + ".undo")
+{
+   m_cloned = cloneFile(originalImg, outputImg);
+   m_imgLength = static_cast<u32>(boost::filesystem::file_size(outputImg));
+
+   m_journal.open(m_journalName.c_str(), ios::binary | ios::trunc);
+   if (!m_journal) throw exception(("Unable to create " + m_journalName).c_str());
+
+   m_journal.exceptions(ios_base::badbit);
+   m_journal.write((char *)&m_imgLength, sizeof(m_imgLength));
+   m_journal.flush();
+}
+
+/**
+* Saves the data about to be overwritten into the journal. Only the areas
+* inside the original snapshot are saved, anything past its end is simply
+* cut off on rollback.
+* @param img The snapshot, opened for reading.
+* @param offset Offset of the area to be overwritten.
+* @param len Length of the area (in bytes).
+*/
+void ImgSnapshot::record (istream &img, u32 offset, u32 len)
+{
+   if (offset >= m_imgLength || !len) return;
+   len = min(len, m_imgLength - offset);
+
+   vector<char> original(len);
+
+   img.seekg(offset);
+   img.read(&original[0], len);
+
+   m_journal.write((char *)&offset, sizeof(offset));
+   m_journal.write((char *)&len, sizeof(len));
+   m_journal.write(&original[0], len);
+
+   // the journal is handed to the system before the area is overwritten, so a failed
+   // commit can be rolled back (it isn't synced, so it may not survive a power loss)
+   m_journal.flush();
+}
+
+/**
+* Restores every area saved in the journal and the original length of the
+* snapshot, then deletes the journal. The areas are restored backwards, so
+* an area overwritten more than once gets its oldest contents back.
+*/
+void ImgSnapshot::rollback ()
+{
+   m_journal.close();
+
+   ifstream journal(m_journalName.c_str(), ios::binary);
+   if (!journal) throw exception(("Unable to open " + m_journalName).c_str());
+
+   vector<pair<u32, vector<char> > > areas;
+   u32 imgLength = 0, offset = 0, len = 0;
+
+   journal.read((char *)&imgLength, sizeof(imgLength));
+
+   while (journal.read((char *)&offset, sizeof(offset)) && journal.read((char *)&len, sizeof(len)))
+   {
+      areas.push_back(make_pair(offset, vector<char>(len)));
+
+      // an incomplete area means the program stopped before overwriting it
+      if (!journal.read(&areas.back().second[0], len))
+      {
+         areas.pop_back();
+         break;
+      }
+   }
+
+   journal.close();
+
+   fstream img(m_imgName.c_str(), ios::in | ios::out | ios::binary);
+   if (!img) throw exception(("Failed to open " + m_imgName + " file.").c_str());
+
+   img.exceptions(ios_base::badbit);
+
+   for (vector<pair<u32, vector<char> > >::reverse_iterator i = areas.rbegin(); i != areas.rend(); ++i)
+   {
+      img.seekp(i->first);
+      img.write(&i->second[0], i->second.size());
+   }
+
+   img.close();
+
+   boost::filesystem::resize_file(m_imgName, imgLength);
+   boost::filesystem::remove(m_journalName);
+}
+
+/**
+* Deletes the journal, making the changes permanent.
+*/
+void ImgSnapshot::discard ()
+{
+   m_journal.close();
+   boost::filesystem::remove(m_journalName);
+}
+
+/**
+* Creates a file sharing the data blocks of another one, falling back
+* to a sparse copy when the filesystem doesn't support block cloning.
+* @param source Path to the file to be cloned.
+* @param dest Path to the new file.
+* @return True if the data was cloned, false if it was copied.
+*/
+bool ImgSnapshot::cloneFile (const string &source, const string &dest)
+{
+   bool cloned = false;
+
+#ifdef _WIN32
+   HANDLE src = CreateFileA(source.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+   if (src == INVALID_HANDLE_VALUE) throw exception(("Failed to open " + source + " file.").c_str());
+
+   HANDLE dst = CreateFileA(dest.c_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
+
+   if (dst == INVALID_HANDLE_VALUE)
+   {
+      CloseHandle(src);
+      throw exception(("Unable to create " + dest).c_str());
+   }
+
+   LARGE_INTEGER size;
+   DWORD bytes = 0;
+   GetFileSizeEx(src, &size);
+
+   // skipped blocks of the sparse copy only become holes in sparse files
+   DeviceIoControl(dst, FSCTL_SET_SPARSE, 0, 0, 0, 0, &bytes, 0);
+
+   FILE_END_OF_FILE_INFO eof;
+   eof.EndOfFile = size;
+
+   if (SetFileInformationByHandle(dst, FileEndOfFileInfo, &eof, sizeof(eof)))
+   {
+      // cloned areas must end on a cluster boundary, the end of the file is handled by the filesystem
+      DUPLICATE_EXTENTS_DATA extents;
+      extents.FileHandle = src;
+      extents.SourceFileOffset.QuadPart = 0;
+      extents.TargetFileOffset.QuadPart = 0;
+      extents.ByteCount.QuadPart = (size.QuadPart + CopyBlock - 1) / CopyBlock * CopyBlock;
+
+      cloned = DeviceIoControl(dst, FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents), 0, 0, &bytes, 0) != 0;
+   }
+
+   CloseHandle(dst);
+   CloseHandle(src);
+#else
+   int src = open(source.c_str(), O_RDONLY);
+   if (src < 0) throw exception(("Failed to open " + source + " file.").c_str());
+
+   int dst = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+   if (dst < 0)
+   {
+      close(src);
+      throw exception(("Unable to create " + dest).c_str());
+   }
+
+#ifdef FICLONE
+   cloned = ioctl(dst, FICLONE, src) == 0;
+#endif
+
+   close(dst);
+   close(src);
+#endif
+
+   if (!cloned) copySparse(source, dest);
+   return cloned;
+}
+
+/**
+* Copies a file, leaving holes where the original file has blocks of 0x00.
+* The IMG files have many of those, mostly as padding of sectors.
+* @param source Path to the file to be copied.
+* @param dest Path to the new file.
+*/
+void ImgSnapshot::copySparse (const string &source, const string &dest)
+{
+   u32 length = static_cast<u32>(boost::filesystem::file_size(source));
+   boost::filesystem::resize_file(dest, 0);
+   boost::filesystem::resize_file(dest, length);
+
+   ifstream input(source.c_str(), ios::binary);
+   fstream output(dest.c_str(), ios::in | ios::out | ios::binary);
+
+   if (!input) throw exception(("Failed to open " + source + " file.").c_str());
+   if (!output) throw exception(("Failed to open " + dest + " file.").c_str());
+
+   output.exceptions(ios_base::badbit);
+   vector<char> block(CopyBlock);
+
+   for (u32 pos = 0; pos < length; pos += CopyBlock)
+   {
+      u32 len = min(CopyBlock, length - pos);
+      input.read(&block[0], len);
+
+      if (count(block.begin(), block.begin() + len, 0) == static_cast<int>(len))
+         continue;
+
+      output.seekp(pos);
+      output.write(&block[0], len);
+   }
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef IMGSNAPSHOT_HPP
+#define IMGSNAPSHOT_HPP
+
+#include <string>
+#include <fstream>
+#include "common.hpp"
+
+/**
+* Creates the output IMG as a snapshot of the original one and keeps an undo
+* journal with the original contents of every area overwritten afterwards.
+* The snapshot shares the data of the original file whenever the filesystem
+* supports it (block cloning), otherwise a sparse copy is made.
+*/
+class ImgSnapshot
+{
+public:
+   /**
+   * Creates the snapshot and starts a new journal.
+   * @param originalImg Path to the original IMG file.
+   * @param outputImg Path where the snapshot will be created.
+   */
+   ImgSnapshot (const std::string &originalImg, const std::string &outputImg);
+
+   /**
+   * Saves the data about to be overwritten into the journal. The journal is
+   * flushed before returning, so the data can be written right after.
+   * @param img The snapshot, opened for reading.
+   * @param offset Offset of the area to be overwritten.
+   * @param len Length of the area (in bytes).
+   */
+   void record (std::istream &img, u32 offset, u32 len);
+
+   /**
+   * Restores every area saved in the journal and the original length
+   * of the snapshot, then deletes the journal.
+   */
+   void rollback ();
+
+   /**
+   * Deletes the journal, making the changes permanent.
+   */
+   void discard ();
+
+   /**
+   * Tells whether the snapshot shares its data with the original file.
+   * @return True if the data was cloned, false if it was copied.
+   */
+   bool cloned () const { return m_cloned; }
+
+private:
+   static bool cloneFile (const std::string &source, const std::string &dest);
+   static void copySparse (const std::string &source, const std::string &dest);
+
+   std::string m_imgName;     /**< Path to the snapshot.               */
+   std::string m_journalName; /**< Path to the undo journal.           */
+   std::ofstream m_journal;   /**< Undo journal.                       */
+   u32 m_imgLength;           /**< Length of the snapshot when created. */
+   bool m_cloned;             /**< Whether block cloning was used.     */
+};
+
+#endif //~IMGSNAPSHOT_HPP
\ No newline at end of file
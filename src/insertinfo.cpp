@@ -100,6 +100,9 @@ void FF8InserterInfo::loadFromFile (const string &fileName)
 
             string version = curScriptNd.getAttribute("version");
             if (!version.empty()) last.m_version = from_iso_string(version);
+
+            if (curScriptNd.isAttributeSet("codes"))
+               last.m_codes = curScriptNd.getAttribute("codes");
          }
 
          if (curFileNd.nChildNode("Insert"))
@@ -163,6 +166,9 @@ void FF8InserterInfo::saveToFile (const string &fileName)
 
             ptime &v = k->m_version;
             curScriptNd.addAttribute("version", v.is_not_a_date_time() ? "" : to_iso_string(v).c_str());
+
+            if (!k->m_codes.empty())
+               curScriptNd.addAttribute("codes", k->m_codes.c_str());
          }
 
          // if this file has a valid version, create the apropriate node
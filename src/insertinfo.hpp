@@ -17,7 +17,7 @@
  */
 
 #ifndef INSERTINFO_HPP
-#define INSERTINGO_HPP
+#define INSERTINFO_HPP
 
 #include <string>
 #include <vector>
@@ -39,6 +39,8 @@ struct FF8InserterScript
    int m_format;
    u32 m_ptrOffset;
    u32 m_textOffset;
+
+   std::string m_codes; /**< Codes used in the script when dumped (see CodeUsage). */
 };
 
 //============================================================================================
@@ -179,4 +181,4 @@ private:
    std::map <std::string, FF8InserterFolder> m_folders;
 };
 
-#endif //~INSERTINGO_HPP
\ No newline at end of file
+#endif //~INSERTINFO_HPP
\ No newline at end of file
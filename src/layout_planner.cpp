@@ -0,0 +1,327 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "layout_planner.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <exception>
+
+using namespace std;
+
+/**
+* Registers the entries of an index, marking the sectors of each file as used.
+* @param indexFile Name of the file holding the index (empty for the main index).
+* @param entries Pointer to the first entry of the index.
+* @param count Number of entries.
+* @param entryOff Offset of the first entry inside its file.
+*/
+void LayoutPlanner::loadIndex (const string &indexFile, const u8 *entries, u32 count, u32 entryOff)
+{
+   if (m_mapped)
+      throw exception("LayoutPlanner::loadIndex should be called before planning any moves.");
+
+   const u32 *cur = (const u32 *)entries;
+
+   for (u32 i = 0; i < count; i++, cur += 2)
+   {
+      // unused entries don't take any space
+      if (cur[0] == 0x00000000 || cur[1] == 0) continue;
+
+      Extent ext(cur[0] - m_discSector, sectors(cur[1]), cur[1]);
+      m_entries[make_pair(indexFile, entryOff + i * 8)] = ext;
+   }
+}
+
+/**
+* Marks an area of the IMG that isn't described by any index entry as used.
+* @param offset Offset of the area inside the IMG.
+* @param length Length of the area (in bytes).
+*/
+void LayoutPlanner::reserve (u32 offset, u32 length)
+{
+   if (m_mapped)
+      throw exception("LayoutPlanner::reserve should be called before planning any moves.");
+
+   m_reserved.push_back(Extent(offset / m_secSize, sectors(offset % m_secSize + length), length));
+}
+
+/**
+* Requests a new length for the file referenced by the given index entry.
+* @param entry The index entry of the file.
+* @param newLength The new length of the file (in bytes).
+*/
+void LayoutPlanner::request (const entryref_type &entry, u32 newLength)
+{
+   if (!m_entries.count(entry))
+      throw exception("Can't relocate a file that isn't referenced by any index.");
+
+   m_requests[entry] = newLength;
+}
+
+/**
+* Finds a position for every pending request in a single pass. Files that still
+* fit in their sectors are handled first, so the sectors released by the others
+* are already available when the grown files are placed.
+* @return The moves describing the new layout and the index updates.
+*/
+vector<LayoutPlanner::Move> LayoutPlanner::plan ()
+{
+   if (!m_mapped) buildFreeMap();
+
+   vector<Move> moves;
+   vector<pair<u32, entryref_type> > pending;
+
+   for (map<entryref_type, u32>::iterator i = m_requests.begin(); i != m_requests.end(); ++i)
+   {
+      Extent &ext = m_entries[i->first];
+      u32 need = sectors(i->second);
+
+      if (need <= ext.numSectors)
+      {
+         Move m = { i->first, ext.sector * m_secSize, ext.length, ext.sector * m_secSize, i->second, InPlace };
+         moves.push_back(m);
+
+         // a file that shrank gives its last sectors back
+         release(ext.sector + need, ext.numSectors - need);
+         ext.numSectors = need, ext.length = i->second;
+      }
+      else
+      {
+         release(ext.sector, ext.numSectors);
+         pending.push_back(make_pair(ext.sector, i->first));
+      }
+   }
+
+   // tries to grow each file over the free sectors that follow it
+   sort(pending.begin(), pending.end());
+   vector<pair<u32, entryref_type> > remaining;
+
+   for (vector<pair<u32, entryref_type> >::iterator i = pending.begin(); i != pending.end(); ++i)
+   {
+      Extent &ext = m_entries[i->second];
+      u32 newLength = m_requests[i->second];
+
+      if (growInPlace(ext.sector, sectors(newLength)))
+      {
+         Move m = { i->second, ext.sector * m_secSize, ext.length, ext.sector * m_secSize, newLength, Adjacent };
+         moves.push_back(m);
+
+         ext.numSectors = sectors(newLength), ext.length = newLength;
+      }
+      else remaining.push_back(make_pair(sectors(newLength), i->second));
+   }
+
+   // the biggest files are placed first, each one into the smallest hole that fits it
+   sort(remaining.begin(), remaining.end(), greater<pair<u32, entryref_type> >());
+
+   for (vector<pair<u32, entryref_type> >::iterator i = remaining.begin(); i != remaining.end(); ++i)
+   {
+      Extent &ext = m_entries[i->second];
+      u32 newLength = m_requests[i->second];
+      u32 sector;
+      int placement = Hole;
+
+      if (findHole(i->first, sector)) take(sector, i->first);
+      else sector = append(i->first), placement = Append;
+
+      Move m = { i->second, ext.sector * m_secSize, ext.length, sector * m_secSize, newLength, placement };
+      moves.push_back(m);
+
+      ext = Extent(sector, i->first, newLength);
+   }
+
+   // keeps the IMG as small as possible
+   if (!m_free.empty() && m_free.rbegin()->first + m_free.rbegin()->second == m_end)
+   {
+      m_end = m_free.rbegin()->first;
+      m_free.erase(m_end);
+   }
+
+   m_requests.clear();
+   return moves;
+}
+
+/**
+* Encodes the index entry of a planned move in the format used in the IMG.
+* @param move The planned move.
+* @param dest Where the 8-byte entry will be written to.
+*/
+void LayoutPlanner::encodeEntry (const Move &move, u8 *dest) const
+{
+   u32 *entry = (u32 *)dest;
+
+   entry[0] = move.newOffset / m_secSize + m_discSector;
+   entry[1] = move.newLength;
+}
+
+/**
+* Builds the free-space map out of the gaps between all the used areas.
+*/
+void LayoutPlanner::buildFreeMap ()
+{
+   vector<pair<u32, u32> > used;
+
+   for (map<entryref_type, Extent>::iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+      used.push_back(make_pair(i->second.sector, i->second.numSectors));
+
+   for (vector<Extent>::iterator i = m_reserved.begin(); i != m_reserved.end(); ++i)
+      used.push_back(make_pair(i->sector, i->numSectors));
+
+   sort(used.begin(), used.end());
+   u32 pos = 0;
+
+   for (vector<pair<u32, u32> >::iterator i = used.begin(); i != used.end(); ++i)
+   {
+      if (i->first > pos) m_free[pos] = i->first - pos;
+      pos = max(pos, i->first + i->second);
+   }
+
+   if (pos < m_end) m_free[pos] = m_end - pos;
+   else m_end = pos;
+
+   m_mapped = true;
+}
+
+/**
+* Gives sectors back to the free-space map, merging them with their neighbours.
+* @param sector First sector to be released.
+* @param count Number of sectors.
+*/
+void LayoutPlanner::release (u32 sector, u32 count)
+{
+   if (!count) return;
+
+   map<u32, u32>::iterator next = m_free.lower_bound(sector);
+
+   if (next != m_free.begin())
+   {
+      map<u32, u32>::iterator prev = next;
+      --prev;
+
+      if (prev->first + prev->second == sector)
+      {
+         sector = prev->first, count += prev->second;
+         m_free.erase(prev);
+      }
+   }
+
+   if (next != m_free.end() && sector + count == next->first)
+   {
+      count += next->second;
+      m_free.erase(next);
+   }
+
+   m_free[sector] = count;
+}
+
+/**
+* Takes sectors from the free-space map. The free area at the end of the IMG
+* is allowed to grow, which makes the IMG itself grow.
+* @param sector First sector to be taken.
+* @param count Number of sectors.
+*/
+void LayoutPlanner::take (u32 sector, u32 count)
+{
+   map<u32, u32>::iterator area = m_free.upper_bound(sector);
+
+   if (area == m_free.begin())
+      throw exception("LayoutPlanner tried to take sectors that aren't free.");
+
+   --area;
+   u32 first = area->first, last = area->first + area->second;
+
+   if (last == m_end && sector + count > m_end) m_end = last = sector + count;
+   if (sector + count > last) throw exception("LayoutPlanner tried to take sectors that aren't free.");
+
+   m_free.erase(area);
+
+   if (sector > first) m_free[first] = sector - first;
+   if (sector + count < last) m_free[sector + count] = last - sector - count;
+}
+
+/**
+* Checks whether a file can grow over the free sectors that follow its start,
+* taking those sectors if it does.
+* @param sector First sector of the file (already released).
+* @param count Number of sectors the file needs.
+* @return True if the file could grow in place, false otherwise.
+*/
+bool LayoutPlanner::growInPlace (u32 sector, u32 count)
+{
+   map<u32, u32>::iterator area = m_free.upper_bound(sector);
+   if (area == m_free.begin()) return false;
+
+   --area;
+   u32 last = area->first + area->second;
+
+   if (last <= sector || (last != m_end && last - sector < count))
+      return false;
+
+   take(sector, count);
+   return true;
+}
+
+/**
+* Finds the smallest free hole inside the IMG that is able to hold a file.
+* @param count Number of sectors the file needs.
+* @param sector Where the first sector of the hole will be stored.
+* @return True if a hole was found, false otherwise.
+*/
+bool LayoutPlanner::findHole (u32 count, u32 &sector) const
+{
+   u32 best = 0;
+   bool found = false;
+
+   for (map<u32, u32>::const_iterator i = m_free.begin(); i != m_free.end(); ++i)
+   {
+      // the area at the end of the IMG is only used when appending
+      if (i->first + i->second == m_end) continue;
+
+      if (i->second >= count && (!found || i->second < best))
+      {
+         sector = i->first, best = i->second;
+         found = true;
+
+         if (best == count) break;
+      }
+   }
+
+   return found;
+}
+
+/**
+* Places a file at the end of the IMG, reusing any free sectors found there.
+* @param count Number of sectors the file needs.
+* @return First sector of the file.
+*/
+u32 LayoutPlanner::append (u32 count)
+{
+   if (!m_free.empty() && m_free.rbegin()->first + m_free.rbegin()->second == m_end)
+   {
+      u32 sector = m_free.rbegin()->first;
+      take(sector, count);
+
+      return sector;
+   }
+
+   u32 sector = m_end;
+   m_end += count;
+
+   return sector;
+}
\ No newline at end of file
@@ -0,0 +1,147 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef LAYOUTPLANNER_HPP
+#define LAYOUTPLANNER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include "common.hpp"
+
+/**
+* Keeps a map of the sectors used by every file referenced from the IMG indices
+* and decides where the files that grew during a rebuild should be placed.
+* Files are kept in place whenever possible, then grown into the free sectors
+* right after them, then moved into free holes and, at last, to the end of the IMG.
+*/
+class LayoutPlanner
+{
+public:
+   /**
+   * Identifies an index entry by the file holding the index (an empty name
+   * stands for the main index inside the IMG) and the entry offset in that file.
+   */
+   typedef std::pair<std::string, u32> entryref_type;
+
+   enum {
+      InPlace,  /**< File still fits inside its original sectors       */
+      Adjacent, /**< File grew into the free sectors right after it    */
+      Hole,     /**< File was moved into a free area inside the IMG    */
+      Append    /**< File was moved to the end of the IMG              */
+   };
+
+   /**
+   * Describes the new position of a file and the index update it requires.
+   */
+   typedef struct tagFF8LayoutMove {
+      entryref_type entry; /**< Index entry to be updated.             */
+      u32 oldOffset;       /**< Original offset inside the IMG.         */
+      u32 oldLength;       /**< Original length (in bytes).             */
+      u32 newOffset;       /**< New offset inside the IMG.              */
+      u32 newLength;       /**< New length (in bytes).                  */
+      int placement;       /**< How the new position was found.         */
+   } Move;
+
+   /**
+   * @param secSize Size of each sector (in bytes).
+   * @param discSector Sector position of the IMG file inside the disc image.
+   * @param imgLength Current length of the IMG file (in bytes).
+   */
+   LayoutPlanner (u16 secSize, u32 discSector, u32 imgLength) :
+      m_secSize(secSize), m_discSector(discSector), m_end(sectors(imgLength)), m_mapped(false) { }
+
+   /**
+   * Registers the entries of an index, marking the sectors of each file as used.
+   * @param indexFile Name of the file holding the index (empty for the main index).
+   * @param entries Pointer to the first entry of the index.
+   * @param count Number of entries.
+   * @param entryOff Offset of the first entry inside its file.
+   */
+   void loadIndex (const std::string &indexFile, const u8 *entries, u32 count, u32 entryOff);
+
+   /**
+   * Marks an area of the IMG that isn't described by any index entry as used.
+   * @param offset Offset of the area inside the IMG.
+   * @param length Length of the area (in bytes).
+   */
+   void reserve (u32 offset, u32 length);
+
+   /**
+   * Requests a new length for the file referenced by the given index entry.
+   * @param entry The index entry of the file.
+   * @param newLength The new length of the file (in bytes).
+   */
+   void request (const entryref_type &entry, u32 newLength);
+
+   /**
+   * Finds a position for every pending request in a single pass.
+   * @return The moves describing the new layout and the index updates.
+   */
+   std::vector<Move> plan ();
+
+   /**
+   * Encodes the index entry of a planned move in the format used in the IMG.
+   * @param move The planned move.
+   * @param dest Where the 8-byte entry will be written to.
+   */
+   void encodeEntry (const Move &move, u8 *dest) const;
+
+   /**
+   * Length of the IMG after the planned moves, trailing free sectors excluded.
+   * @return Length of the IMG (in bytes).
+   */
+   u32 imageLength () const { return m_end * m_secSize; }
+
+private:
+   /**
+   * A contiguous area of the IMG, measured in sectors.
+   */
+   typedef struct tagFF8LayoutExtent {
+      tagFF8LayoutExtent (u32 start = 0, u32 count = 0, u32 len = 0) :
+         sector(start), numSectors(count), length(len) { }
+
+      u32 sector;     /**< First sector (relative to the IMG start). */
+      u32 numSectors; /**< Number of sectors.                         */
+      u32 length;     /**< Length of the file (in bytes).             */
+   } Extent;
+
+   u32 sectors (u32 length) const {
+      return (length + m_secSize - 1) / m_secSize;
+   }
+
+   void buildFreeMap ();
+   void release (u32 sector, u32 count);
+   void take (u32 sector, u32 count);
+   bool growInPlace (u32 sector, u32 count);
+   bool findHole (u32 count, u32 &sector) const;
+   u32 append (u32 count);
+
+   u16 m_secSize;    /**< Size of each sector (in bytes).                     */
+   u32 m_discSector; /**< Sector position of the IMG inside the disc image.  */
+   u32 m_end;        /**< Number of sectors used by the IMG.                  */
+   bool m_mapped;    /**< Whether the free-space map was already built.       */
+
+   std::map<entryref_type, Extent> m_entries; /**< Every file from all indices.  */
+   std::vector<Extent> m_reserved;            /**< Areas not owned by any file.  */
+   std::map<entryref_type, u32> m_requests;   /**< Pending length changes.       */
+   std::map<u32, u32> m_free;                 /**< Free areas (sector -> count). */
+};
+
+#endif //~LAYOUTPLANNER_HPP
\ No newline at end of file
@@ -34,8 +34,17 @@
 #include "extractinfo.hpp"
 #include "insertinfo.hpp"
 #include "file_extractor.hpp"
+#include "disc_image.hpp"
 #include "text_dumper.hpp"
 #include "text_inserter.hpp"
+#include "block_cache.hpp"
+#include "layout_planner.hpp"
+#include "img_inserter.hpp"
+#include "patch_builder.hpp"
+#include "patch_applier.hpp"
+#include "dte_optimizer.hpp"
+#include "code_usage.hpp"
+#include "capacity_report.hpp"
 
 using namespace std;
 using namespace boost::filesystem;
@@ -43,6 +52,71 @@ using namespace boost::posix_time;
 using boost::format;
 using boost::lexical_cast;
 
+/**
+* Creates the script files for each table. The first one is the main table,
+* whose script is saved at the given path. The others are saved into a folder
+* named after their table, next to it.
+* @param scriptPath Path of the script dumped with the main table.
+* @param tableNames Names of the additional tables.
+* @param files Where the script files are kept until the dump is over (see commitScripts).
+* @return The script files, in the order used by TextDumper.
+*/
+static TextDumper::sinks_type openScripts (const path &scriptPath, const vector<string> &tableNames,
+   vector<boost::shared_ptr<FileSink> > &files)
+{
+   TextDumper::sinks_type sinks;
+
+   for (u32 t = 0; t <= tableNames.size(); t++)
+   {
+      path curPath = scriptPath;
+
+      if (t)
+      {
+         create_directories(scriptPath.parent_path() / tableNames[t - 1]);
+         curPath = scriptPath.parent_path() / tableNames[t - 1] / scriptPath.filename();
+      }
+
+      files.push_back(boost::shared_ptr<FileSink>(new FileSink(curPath.string())));
+      sinks.push_back(files.back().get());
+   }
+
+   return sinks;
+}
+
+/**
+* Replaces the scripts with the text dumped into them, once the dump is over.
+* Scripts left out (as when the dump failed) keep their old text.
+* @param files The script files created by openScripts, which are released.
+*/
+static void commitScripts (vector<boost::shared_ptr<FileSink> > &files)
+{
+   for (vector<boost::shared_ptr<FileSink> >::iterator i = files.begin(); i != files.end(); ++i)
+      (*i)->commit();
+
+   files.clear();
+}
+
+/**
+* Reads a file extracted from the IMG, decompressing it if needed.
+* @param filePath Path of the file.
+* @param lzs Whether the file is LZS-compressed.
+* @return The file data.
+*/
+static TextDumper::filedata_type loadFile (const path &filePath, bool lzs)
+{
+   ifstream file(filePath.native(), ios::binary);
+   if (!file) throw exception(("Unable to open " + filePath.filename().string()).c_str());
+
+   u32 fileLen = static_cast<u32>(file_size(filePath));
+   boost::shared_array<u8> data(new u8[fileLen]);
+   file.read((char *)data.get(), fileLen);
+
+   if (!lzs) return make_pair(data, fileLen);
+
+   LZSDecoder decoder(data.get() + 4, *((u32 *)data.get()));
+   return decoder.decode();
+}
+
 int main ()
 {
    cout <<                                                endl
@@ -70,20 +144,26 @@ int main ()
       cout << "1. Extract from disc and dump into script files" << endl
            << "2. Rebuild files using modified script files"    << endl
            << "3. Insert modified files back into IMG file"     << endl
+           << "4. Create a patch from the rebuilt IMG file"     << endl
+           << "5. Apply a patch to the original IMG file"       << endl
+           << "6. Optimize the table DTEs for the script files"  << endl
+           << "7. Dump again the scripts affected by table changes" << endl
+           << "8. Report the room taken by the text of every file" << endl
+           << "9. Verify the patched IMG file against its patch" << endl
            << "   Pick one: ";
 
       getline(cin, userInput), cout << endl;
       int option = lexical_cast<int>(userInput);
 
-      if (!(option >= 1 && option <= 3))
+      if (!(option >= 1 && option <= 9))
          throw exception("There's no such option.");
 
       Dictionary dic;
-      dic.loadFromFile("ff8complete.tbl");
+      dic.loadFromFile("ff8complete.tbl", true);
 
       switch (option)
       {
-         enum { Extract = 1, Rebuild, Insert };
+         enum { Extract = 1, Rebuild, Insert, CreatePatch, ApplyPatch, OptimizeTable, Redump, Capacity, VerifyPatch };
 
          //============================================================================================
          // Extract from disc and dump into script files
@@ -96,6 +176,30 @@ int main ()
             FileExtractor extractor(extInfo, "fieldbattle.tbl");
             u32 idxEnd = extractor.loadMainIndex();
 
+            // records let the scripts be inserted without walking the files again
+            cout << "Write the pointer records into the scripts? (y/n): ";
+            getline(cin, userInput), cout << endl;
+            bool records = userInput == "y" || userInput == "Y";
+
+            // any table inside the Tables folder gets its own scripts, dumped along with the main ones
+            vector<boost::shared_ptr<Dictionary> > extraTables;
+            vector<string> tableNames;
+            TextDumper::tables_type tables(1, &dic);
+
+            if (is_directory("Tables"))
+            {
+               for (directory_iterator i("Tables"); i != directory_iterator(); ++i)
+               {
+                  if (i->path().extension() != ".tbl") continue;
+
+                  extraTables.push_back(boost::shared_ptr<Dictionary>(new Dictionary));
+                  extraTables.back()->loadFromFile(i->path().string(), true);
+
+                  tables.push_back(extraTables.back().get());
+                  tableNames.push_back(i->path().stem().string());
+               }
+            }
+
             path folder = "Disc" + lexical_cast<string>(discNum);
             create_directories(folder / "Other" / "Original");
             create_directories(folder / "Other" / "Modified");
@@ -138,7 +242,12 @@ int main ()
                // dump all the text data in the current file into scripts
                if (cur.hasTextData())
                {
-                  TextDumper dumper(fileData, dic);
+                  TextDumper dumper(fileData, tables);
+                  dumper.records(records);
+
+                  vector<TextDumper::Section> sections;
+                  vector<string> scriptNames;
+                  vector<vector<boost::shared_ptr<FileSink> > > files;
 
                   for (FF8FileInfo::txtdata_iterator j = cur.begin(); j != cur.end(); ++j)
                   {
@@ -159,21 +268,39 @@ int main ()
                      {
                         cout << " Dumping to " << scriptPath.filename() << endl;
 
-                        string script;
-                        dumper.dump(script, j->m_format, j->m_ptrOff, j->m_txtOff);
+                        TextDumper::Section section(j->m_format, j->m_ptrOff, j->m_txtOff);
+                        vector<boost::shared_ptr<FileSink> > sectionFiles;
+                        section.sinks = openScripts(scriptPath, tableNames, sectionFiles);
 
-                        ofstream scriptFile(scriptPath.native());
-                        if (!scriptFile) throw exception(("Unable to create " + scriptPath.filename().string()).c_str());
+                        sections.push_back(section);
+                        scriptNames.push_back(scriptPath.filename().string());
+                        files.push_back(sectionFiles);
+                     }
+                     catch (const exception &e) {
+                        cout << " Error: " << e.what() << endl;
+                     }
+                  }
 
-                        scriptFile << script;
+                  // all the sections of the file are dumped at once
+                  dumper.dump(sections);
 
-                        // collect information about the script that was just dumped
-                        insInfo["Other"][filePath.filename().string()].add(
-                           scriptPath.filename().string(), j->m_format, j->m_ptrOff, j->m_txtOff);
+                  for (u32 k = 0; k < sections.size(); k++)
+                  {
+                     try
+                     {
+                        if (!sections[k].error.empty()) throw exception(sections[k].error.c_str());
+                        commitScripts(files[k]);
                      }
                      catch (const exception &e) {
-                        cout << " Error: " << e.what() << endl;
+                        cout << " Error in " << scriptNames[k] << ": " << e.what() << endl;
+                        files[k].clear();
+                        continue;
                      }
+
+                     // collect information about the script that was just dumped
+                     FF8InserterFile &info = insInfo["Other"][filePath.filename().string()];
+                     info.add(scriptNames[k], sections[k].type, sections[k].ptrOff, sections[k].txtOff);
+                     info.last().m_codes = sections[k].usage.toString();
                   }
 
                   cout << endl;
@@ -252,6 +379,7 @@ int main ()
                      {
                         path scriptPath = subPath.parent_path() / "Script" / subPath.filename();
                         scriptPath.replace_extension(".txt");
+                        CodeUsage usage;
 
                         if (curFolder == "Field")
                         {
@@ -261,34 +389,29 @@ int main ()
                            LZSDecoder decoder(lzsDataPtr + 4, *lzsLen);
                            LZSDecoder::filedata_type decData = decoder.decode();
 
-                           TextDumper dumper(decData, dic);
+                           TextDumper dumper(decData, tables);
                            cout << " Dumping to " << scriptPath.filename() << endl;
 
-                           string script;
-                           dumper.dump(script, TextDumper::Field);
-
-                           ofstream scriptFile(scriptPath.native());
-                           if (!scriptFile) throw exception(("Unable to create " + scriptPath.filename().string()).c_str());
-
-                           scriptFile << script;
+                           vector<boost::shared_ptr<FileSink> > files;
+                           dumper.dump(openScripts(scriptPath, tableNames, files), TextDumper::Field);
+                           commitScripts(files);
+                           usage = dumper.usage();
                         }
                         else if (curFolder == "Battle")
                         {
-                           TextDumper dumper(result, dic);
+                           TextDumper dumper(result, tables);
                            cout << " Dumping to " << scriptPath.filename() << endl;
 
-                           string script;
-                           dumper.dump(script, TextDumper::Battle);
-
-                           ofstream scriptFile(scriptPath.native());
-                           if (!scriptFile) throw exception(("Unable to create " + scriptPath.filename().string()).c_str());
-
-                           scriptFile << script;
+                           vector<boost::shared_ptr<FileSink> > files;
+                           dumper.dump(openScripts(scriptPath, tableNames, files), TextDumper::Battle);
+                           commitScripts(files);
+                           usage = dumper.usage();
                         }
                         else throw exception("Invalid folder type found in current sub-index");
 
                         // collect information about the script that was just dumped
                         insInfo[curFolder][subPath.filename().string()].add(scriptPath.filename().string());
+                        insInfo[curFolder][subPath.filename().string()].last().m_codes = usage.toString();
                      }
                      catch (const exception &e) {
                         cout << " Error: " << e.what() << endl;
@@ -303,6 +426,10 @@ int main ()
             boost::to_lower(xmlFile);
 
             insInfo.saveToFile(xmlFile);
+
+            // the table used is kept, to find out which scripts are affected when it changes
+            dic.saveToFile((folder / "dump.tbl").string());
+
             cout << "Complete. Information saved into " << xmlFile << endl;
          }
          break;
@@ -320,6 +447,16 @@ int main ()
             FF8InserterInfo info;
             info.loadFromFile(xmlFile);
 
+            // blocks encoded by earlier rebuilds, so only the ones changed since are encoded again
+            string cacheFile = (folder / "blocks.cache").string();
+            BlockCache blockCache(dic);
+            blockCache.loadFromFile(cacheFile);
+
+            // repeated menu strings can share their storage, making room for longer ones
+            cout << "Share the storage of repeated strings in menu files? (y/n): ";
+            getline(cin, userInput), cout << endl;
+            bool compaction = userInput == "y" || userInput == "Y";
+
             for (FF8InserterInfo::folder_iterator i = info.begin(); i != info.end(); ++i)
             {
                FF8InserterFolder curFolder = i->second;
@@ -367,29 +504,37 @@ int main ()
                         // read original file data into buffer
                         originalFile.read((char *)buffer.get(), originalLen);
                         TextInserter inserter(make_pair(buffer, bufferLen), dic);
+                        inserter.cache(&blockCache);
+                        inserter.compaction(compaction);
+
+                        vector<TextInserter::Section> sections;
+                        vector<path> scriptPaths;
 
-                        // used to correct text offsets that were based on original file data
-                        int delta = 0;
-                     
                         for (map<path, FF8InserterScript>::iterator s = scripts.begin(); s != scripts.end(); ++s)
                         {
-                           try
+                           ifstream scriptFile(s->first.native());
+
+                           if (!scriptFile)
                            {
-                              cout << " Inserting " << s->first.filename() << endl;
-                              FF8InserterScript cur = s->second;
+                              cout << " Error: Unable to open " << s->first.filename() << endl;
+                              continue;
+                           }
 
-                              ifstream scriptFile(s->first.native());
-                              if (!scriptFile) throw exception(("Unable to open " + s->first.filename().string()).c_str());
+                           // read script content into string
+                           string script((istreambuf_iterator<char>(scriptFile)), istreambuf_iterator<char>());
 
-                              // read script content into string
-                              string script((istreambuf_iterator<char>(scriptFile)), istreambuf_iterator<char>());
-                              inserter.insert(script, cur.m_format, cur.m_ptrOffset, cur.m_textOffset + delta);
+                           FF8InserterScript cur = s->second;
+                           sections.push_back(TextInserter::Section(script, cur.m_format, cur.m_ptrOffset, cur.m_textOffset));
+                           scriptPaths.push_back(s->first);
+                        }
 
-                              delta = inserter.getModifiedFile().second - originalLen;
-                           }
-                           catch (const exception &e) {
-                              cout << " Error: " << e.what() << endl;
-                           }
+                        // all the sections of the file are inserted at once, using their original offsets
+                        inserter.insert(sections);
+
+                        for (u32 k = 0; k < sections.size(); k++)
+                        {
+                           cout << " Inserting " << scriptPaths[k].filename() << endl;
+                           if (!sections[k].error.empty()) cout << " Error: " << sections[k].error << endl;
                         }
 
                         // get the modified file
@@ -441,6 +586,7 @@ int main ()
                               if (curFolder.name() == "Battle")
                               {
                                  TextInserter inserter(make_pair(originalData, originalLen), dic);
+                                 inserter.cache(&blockCache);
 
                                  inserter.insert(script, TextInserter::Battle);
                                  TextInserter::filedata_type result = inserter.getModifiedFile();
@@ -461,6 +607,7 @@ int main ()
                                  LZSDecoder::filedata_type decData = decoder.decode();
 
                                  TextInserter inserter(decData, dic);
+                                 inserter.cache(&blockCache);
 
                                  inserter.insert(script, TextInserter::Field);
                                  TextInserter::filedata_type result = inserter.getModifiedFile();
@@ -481,12 +628,380 @@ int main ()
                   }
                }
             }
+
+            blockCache.saveToFile(cacheFile);
          }
          break;
 
+         //============================================================================================
+         // Insert modified files back into IMG file
+         //============================================================================================
          case Insert:
          {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            string xmlFile = folder.string() + ".xml";
+            boost::to_lower(xmlFile);
+
+            FF8InserterInfo info;
+            info.loadFromFile(xmlFile);
+
+            // sector size and IMG position are needed to address the index entries
+            FF8ExtractInfo extInfo;
+            extInfo.loadFromFile("extractinfo.xml", discNum);
+
+            path imgPath = folder / info.img();
+            cout << "Creating " << imgPath.filename() << endl;
+
+            ImgInserter imgInserter(info.img(), imgPath.string(), extInfo.secSize(), extInfo.indexSector());
+            cout << (imgInserter.cloned() ? " Cloned from " : " Copied from ") << info.img() << endl << endl;
+            imgInserter.loadMainIndex(info.indexStart(), info.indexEnd());
+
+            // used to name the files when reporting where they were placed
+            map<LayoutPlanner::entryref_type, string> names;
+
+            for (FF8InserterInfo::folder_iterator i = info.begin(); i != info.end(); ++i)
+            {
+               FF8InserterFolder &curFolder = i->second;
+               string indexFile = curFolder.name() == "Other" ? "" : curFolder.indexFile();
+
+               // load the sub-index from the original file holding it (field index is lzs-compressed)
+               if (!indexFile.empty())
+               {
+                  path indexPath = folder / "Other" / "Original" / indexFile;
+
+                  ifstream idxFile(indexPath.native(), ios::binary);
+                  if (!idxFile) throw exception(("Unable to open " + indexPath.filename().string()).c_str());
+
+                  u32 idxLen = static_cast<u32>(file_size(indexPath));
+                  boost::shared_array<u8> idxData(new u8[idxLen]);
+                  idxFile.read((char *)idxData.get(), idxLen);
+
+                  ImgInserter::filedata_type subIndex = make_pair(idxData, idxLen);
+                  bool compressed = indexPath.extension() == ".lzs";
+
+                  if (compressed)
+                  {
+                     LZSDecoder decoder(idxData.get() + 4, *((u32 *)idxData.get()));
+                     subIndex = decoder.decode();
+                  }
+
+                  u16 indexId = static_cast<u16>(info["Other"][indexFile].id());
+                  imgInserter.loadSubIndex(indexFile, indexId, subIndex, curFolder.indexStart(), curFolder.indexEnd(), compressed);
+
+                  names[make_pair(string(), info.indexStart() + indexId * 8)] = indexFile;
+               }
+
+               for (FF8InserterFolder::file_iterator j = curFolder.begin(); j != curFolder.end(); ++j)
+               {
+                  path modifiedPath = folder / curFolder.name() / "Modified" / j->second.name();
+                  if (!exists(modifiedPath)) continue;
+
+                  ifstream modifiedFile(modifiedPath.native(), ios::binary);
+                  if (!modifiedFile) throw exception(("Unable to open " + modifiedPath.filename().string()).c_str());
+
+                  u32 modifiedLen = static_cast<u32>(file_size(modifiedPath));
+                  boost::shared_array<u8> modifiedData(new u8[modifiedLen]);
+                  modifiedFile.read((char *)modifiedData.get(), modifiedLen);
+
+                  imgInserter.add(indexFile, static_cast<u16>(j->second.id()), make_pair(modifiedData, modifiedLen));
+                  names[make_pair(indexFile, (indexFile.empty() ? info.indexStart() : curFolder.indexStart()) + j->second.id() * 8)] = j->second.name();
+
+                  j->second.update(second_clock::local_time());
+               }
+            }
+
+            vector<LayoutPlanner::Move> moves = imgInserter.commit();
+            const char *placement[] = { "in place", "grown in place", "moved into free space", "moved to the end" };
+
+            for (vector<LayoutPlanner::Move>::iterator i = moves.begin(); i != moves.end(); ++i)
+            {
+               string name = names.count(i->entry) ? names[i->entry] : i->entry.first;
+               cout << "Inserted " << name << " (" << placement[i->placement] << ")" << endl;
+
+               if (i->newOffset != i->oldOffset)
+                  cout << " Offset " << hexEncode<u32>(i->oldOffset) << " -> " << hexEncode<u32>(i->newOffset) << endl;
+            }
+
+            info.saveToFile(xmlFile);
+            cout << endl << "Complete. " << moves.size() << " files inserted into " << imgPath.filename() << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Create a patch from the rebuilt IMG file
+         //============================================================================================
+         case CreatePatch:
+         {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            string xmlFile = folder.string() + ".xml";
+            boost::to_lower(xmlFile);
+
+            FF8InserterInfo info;
+            info.loadFromFile(xmlFile);
+
+            FF8ExtractInfo extInfo;
+            extInfo.loadFromFile("extractinfo.xml", discNum);
+
+            path imgPath = folder / info.img();
+            path patchPath = folder / path(info.img()).stem();
+            patchPath.replace_extension(".bps");
+
+            // the areas compared are addressed by their position inside the IMG
+            if (DiscImage::isDiscImage(info.img()))
+               throw exception("Patches can only be created from IMG files, not from disc images.");
+
+            cout << "Comparing " << imgPath.filename() << " against the original IMG file" << endl;
+
+            PatchBuilder builder(info.img(), imgPath.string(), extInfo.secSize(), extInfo.indexSector());
+            builder.addManifest(info);
+
+            u32 patchLen = builder.build(patchPath.string());
+            cout << "Complete. " << patchLen << " bytes written into " << patchPath.filename() << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Apply a patch to the original IMG file
+         //============================================================================================
+         case ApplyPatch:
+         {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            FF8ExtractInfo extInfo;
+            extInfo.loadFromFile("extractinfo.xml", discNum);
+
+            path imgPath = folder / extInfo.imgName();
+            path patchPath = folder / path(extInfo.imgName()).stem();
+            patchPath.replace_extension(".bps");
+
+            create_directories(folder);
+            cout << "Applying " << patchPath.filename() << " to " << extInfo.imgName() << endl;
+
+            PatchApplier applier(patchPath.string());
+            applier.apply(extInfo.imgName(), imgPath.string());
+
+            cout << "Complete. Patched IMG file saved as " << imgPath << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Verify the patched IMG file against its patch
+         //============================================================================================
+         case VerifyPatch:
+         {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            FF8ExtractInfo extInfo;
+            extInfo.loadFromFile("extractinfo.xml", discNum);
+
+            // same files used when the patch is applied
+            path imgPath = folder / extInfo.imgName();
+            path patchPath = folder / path(extInfo.imgName()).stem();
+            patchPath.replace_extension(".bps");
+
+            cout << "Verifying " << imgPath << " against " << patchPath.filename() << endl;
+
+            PatchApplier applier(patchPath.string());
+
+            if (applier.verify(extInfo.imgName(), imgPath.string()))
+               cout << "Complete. Both IMG files match the patch." << endl;
+            else
+               cout << "Error: The IMG files don't match the checksums stored in the patch." << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Optimize the table DTEs for the script files
+         //============================================================================================
+         case OptimizeTable:
+         {
+            DteOptimizer optimizer(dic);
+
+            // the table is shared by all discs, so every modified script counts
+            for (int disc = 1; disc <= 4; disc++)
+            {
+               path folder = "Disc" + lexical_cast<string>(disc);
+               if (!is_directory(folder)) continue;
+
+               for (directory_iterator i(folder); i != directory_iterator(); ++i)
+               {
+                  path scriptFolder = i->path() / "Modified" / "Script";
+                  if (!is_directory(scriptFolder)) continue;
+
+                  for (directory_iterator j(scriptFolder); j != directory_iterator(); ++j)
+                  {
+                     if (j->path().extension() != ".txt") continue;
+
+                     ifstream scriptFile(j->path().native());
+                     if (!scriptFile) throw exception(("Unable to open " + j->path().filename().string()).c_str());
+
+                     string script((istreambuf_iterator<char>(scriptFile)), istreambuf_iterator<char>());
+                     optimizer.addScript((folder / j->path().filename()).string(), script);
+                  }
+               }
+            }
+
+            cout << "Counting pairs of characters in the script files" << endl;
+            u32 assigned = optimizer.optimize();
+
+            vector<DteOptimizer::ScriptSize> sizes = optimizer.report();
+            u32 before = 0, after = 0;
+
+            for (vector<DteOptimizer::ScriptSize>::iterator i = sizes.begin(); i != sizes.end(); ++i)
+            {
+               cout << " " << i->name << ": " << i->before << " -> " << i->after << " bytes" << endl;
+               before += i->before, after += i->after;
+            }
+
+            if (optimizer.skipped())
+               cout << " Warning: " << optimizer.skipped() << " pieces of text can't be encoded and were left out" << endl;
+
+            optimizer.table().saveToFile("ff8optimized.tbl");
+
+            cout << endl << "Complete. " << assigned << " DTEs assigned, text size " << before << " -> " << after
+                 << " bytes. Table saved as ff8optimized.tbl" << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Dump again the scripts affected by table changes
+         //============================================================================================
+         case Redump:
+         {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            string xmlFile = folder.string() + ".xml";
+            boost::to_lower(xmlFile);
+
+            FF8InserterInfo info;
+            info.loadFromFile(xmlFile);
+
+            path tablePath = folder / "dump.tbl";
+            if (!exists(tablePath)) throw exception("The table used in the last dump is missing. Extract the files again.");
+
+            Dictionary previous;
+            previous.loadFromFile(tablePath.string());
+
+            CodeUsage changed = CodeUsage::changes(previous, dic);
+            u32 redumped = 0, total = 0;
+
+            for (FF8InserterInfo::folder_iterator i = info.begin(); i != info.end(); ++i)
+            {
+               for (FF8InserterFolder::file_iterator j = i->second.begin(); j != i->second.end(); ++j)
+               {
+                  path filePath = folder / i->second.name() / "Original" / j->second.name();
+                  TextDumper::filedata_type fileData;
+
+                  for (FF8InserterFile::script_iterator k = j->second.begin(); k != j->second.end(); ++k, total++)
+                  {
+                     // scripts dumped before their codes were recorded are always dumped again
+                     if (!k->m_codes.empty() && !CodeUsage(k->m_codes).intersects(changed)) continue;
+
+                     try
+                     {
+                        path scriptPath = folder / i->second.name() / "Original" / "Script" / k->m_name;
+                        cout << "Dumping to " << scriptPath.filename() << endl;
+
+                        // each file is only read once, even if several of its scripts are affected
+                        if (!fileData.first) fileData = loadFile(filePath, i->second.name() == "Field");
+
+                        int format = k->m_format;
+                        if (i->second.name() == "Field") format = TextDumper::Field;
+                        else if (i->second.name() == "Battle") format = TextDumper::Battle;
+
+                        TextDumper dumper(fileData, dic);
+
+                        // scripts dumped along with their records keep them
+                        char tag[3] = { 0 };
+                        ifstream oldScript(scriptPath.native(), ios::binary);
+                        dumper.records(oldScript.read(tag, 3) && equal(tag, tag + 3, "@@ "));
+                        oldScript.close();
+
+                        FileSink scriptFile(scriptPath.string());
+                        dumper.dump(scriptFile, format, k->m_ptrOffset, k->m_textOffset);
+                        scriptFile.commit();
+
+                        k->m_codes = dumper.usage().toString();
+                        redumped++;
+                     }
+                     catch (const exception &e) {
+                        cout << " Error: " << e.what() << endl;
+
+                        // the table saved below is newer than the script, so it's always dumped again
+                        k->m_codes.clear();
+                     }
+                  }
+               }
+            }
+
+            info.saveToFile(xmlFile);
+            dic.saveToFile(tablePath.string());
+
+            cout << endl << "Complete. " << redumped << " of " << total << " scripts dumped again." << endl;
+         }
+         break;
+
+         //============================================================================================
+         // Report the room taken by the text of every file
+         //============================================================================================
+         case Capacity:
+         {
+            path folder = "Disc" + lexical_cast<string>(discNum);
+
+            string xmlFile = folder.string() + ".xml";
+            boost::to_lower(xmlFile);
+
+            FF8InserterInfo info;
+            info.loadFromFile(xmlFile);
+
+            // the report should match the rebuild, which may share the storage of repeated strings
+            cout << "Share the storage of repeated strings in menu files? (y/n): ";
+            getline(cin, userInput), cout << endl;
+            CapacityReport report(dic, userInput == "y" || userInput == "Y");
+
+            for (FF8InserterInfo::folder_iterator i = info.begin(); i != info.end(); ++i)
+            {
+               for (FF8InserterFolder::file_iterator j = i->second.begin(); j != i->second.end(); ++j)
+               {
+                  try
+                  {
+                     path filePath = folder / i->second.name() / "Original" / j->second.name();
+                     TextInserter::filedata_type fileData;
+
+                     for (FF8InserterFile::script_iterator k = j->second.begin(); k != j->second.end(); ++k)
+                     {
+                        // scripts not changed yet are measured as they were dumped
+                        path scriptPath = folder / i->second.name() / "Modified" / "Script" / k->m_name;
+                        bool modified = exists(scriptPath);
+                        if (!modified) scriptPath = folder / i->second.name() / "Original" / "Script" / k->m_name;
+                        if (!exists(scriptPath)) continue;
+
+                        ifstream scriptFile(scriptPath.native());
+                        if (!scriptFile) throw exception(("Unable to open " + scriptPath.filename().string()).c_str());
+
+                        string script((istreambuf_iterator<char>(scriptFile)), istreambuf_iterator<char>());
+
+                        // each file is only read once, its sections sharing the data
+                        if (!fileData.first) fileData = loadFile(filePath, i->second.name() == "Field");
+
+                        int format = k->m_format;
+                        if (i->second.name() == "Field") format = TextInserter::Field;
+                        else if (i->second.name() == "Battle") format = TextInserter::Battle;
+
+                        report.add(i->second.name() + "/" + k->m_name, fileData, script, modified, format, k->m_ptrOffset, k->m_textOffset);
+                     }
+                  }
+                  catch (const exception &e) {
+                     cout << "Error: " << e.what() << endl;
+                  }
+               }
+            }
 
+            cout << "Measuring " << report.entries().size() << " sections" << endl << endl;
+            report.measure();
+            report.print(cout);
          }
          break;
       }
@@ -0,0 +1,68 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/**
+* Number of threads the work is split between.
+* @return One for each processor (at least one).
+*/
+u32 Parallel::numThreads ()
+{
+   return max(1u, boost::thread::hardware_concurrency());
+}
+
+/**
+* Number of shares some items are split into, which is never more than the
+* number of threads (nor the number of items).
+* @param count Number of items.
+* @return Number of shares.
+*/
+u32 Parallel::numShares (u32 count)
+{
+   return min(numThreads(), count);
+}
+
+/**
+* Splits the items between several threads. The shares differ by at most one
+* item, and each of them gets a thread of its own.
+* @param count Number of items.
+* @param job Called by each thread with its share of the items.
+*/
+void Parallel::run (u32 count, const job_type &job)
+{
+   u32 shares = numShares(count);
+   boost::thread_group workers;
+
+   for (u32 t = 0; t < shares; t++)
+   {
+      // the first (count % shares) shares get one item more than the others
+      u32 first = t * (count / shares) + min(t, count % shares);
+      u32 last = first + count / shares + (t < count % shares ? 1 : 0);
+
+      workers.create_thread(boost::bind(job, first, last, t));
+   }
+
+   workers.join_all();
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <boost/function.hpp>
+#include "common.hpp"
+
+/**
+* Splits a number of items between several threads, one share of about the
+* same size for each of them, and waits for all of them to finish.
+*/
+class Parallel
+{
+public:
+   /** Called with the first item of a share, the item after its last one and the number of the share */
+   typedef boost::function<void (u32, u32, u32)> job_type;
+
+   static u32 numThreads ();
+   static u32 numShares (u32 count);
+
+   static void run (u32 count, const job_type &job);
+};
+
+#endif //~PARALLEL_HPP
\ No newline at end of file
@@ -0,0 +1,263 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "patch_applier.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <boost/crc.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+using boost::iostreams::mapped_file;
+using boost::iostreams::mapped_file_source;
+using boost::iostreams::mapped_file_params;
+
+/**
+* Loads a patch file, checking its integrity and decoding all of its actions.
+* @param patchFile Path to the BPS patch.
+*/
+PatchApplier::PatchApplier (const string &patchFile) :
+   m_sourceSize(0), m_targetSize(0), m_sourceCrc(0), m_targetCrc(0)
+{
+   m_patch.open(patchFile);
+
+   const u8 *patchPtr = (const u8 *)m_patch.data();
+   u32 patchLen = static_cast<u32>(m_patch.size());
+
+   if (patchLen < 19 || !equal(patchPtr, patchPtr + 4, "BPS1"))
+      throw exception((patchFile + " is not a valid BPS patch.").c_str());
+
+   if (checksum(patchPtr, patchLen - 4) != readCrc(patchLen - 4))
+      throw exception((patchFile + " is corrupted.").c_str());
+
+   u32 pos = 4;
+   m_sourceSize = decodeNumber(pos);
+   m_targetSize = decodeNumber(pos);
+
+   // metadata isn't used by these tools
+   u32 metaLen = decodeNumber(pos);
+   pos += metaLen;
+
+   u32 outputOff = 0, sourceRel = 0, targetRel = 0;
+
+   while (pos < patchLen - 12)
+   {
+      u32 value = decodeNumber(pos);
+      Action action = { static_cast<int>(value & 3), outputOff, (value >> 2) + 1, 0 };
+
+      switch (action.command)
+      {
+         case SourceRead:
+            action.inputOff = outputOff;
+            break;
+
+         case TargetRead:
+            action.inputOff = pos;
+            pos += action.length;
+            break;
+
+         default:
+         {
+            u32 rel = decodeNumber(pos);
+            u32 &base = action.command == SourceCopy ? sourceRel : targetRel;
+
+            base = rel & 1 ? base - (rel >> 1) : base + (rel >> 1);
+            action.inputOff = base;
+            base += action.length;
+         }
+      }
+
+      bool valid =
+         (action.command == SourceRead || action.command == SourceCopy) ? action.inputOff + action.length <= m_sourceSize :
+         (action.command == TargetRead) ? pos <= patchLen - 12 : action.inputOff < outputOff;
+
+      if (!valid) throw exception((patchFile + " is corrupted.").c_str());
+
+      m_actions.push_back(action);
+      outputOff += action.length;
+   }
+
+   if (outputOff != m_targetSize)
+      throw exception((patchFile + " is corrupted.").c_str());
+
+   m_sourceCrc = readCrc(patchLen - 12);
+   m_targetCrc = readCrc(patchLen - 8);
+}
+
+/**
+* Creates the patched IMG file. The source file is checked in a separate thread
+* while the actions are split among the worker threads.
+* @param sourceImg Path to the original IMG file.
+* @param targetImg Path where the patched IMG file will be created.
+*/
+void PatchApplier::apply (const string &sourceImg, const string &targetImg)
+{
+   mapped_file_source source(sourceImg);
+
+   if (source.size() != m_sourceSize)
+      throw exception(("The patch can't be applied to " + sourceImg).c_str());
+
+   mapped_file_params params(targetImg);
+   params.flags = mapped_file::readwrite;
+   params.new_file_size = m_targetSize;
+
+   mapped_file target(params);
+
+   const u8 *sourcePtr = (const u8 *)source.data(), *patchPtr = (const u8 *)m_patch.data();
+   u8 *targetPtr = (u8 *)target.data();
+
+   u32 sourceCrc = 0, sourceLen = 0;
+   boost::thread checker(boost::bind(&PatchApplier::calcChecksum, sourceImg, &sourceCrc, &sourceLen));
+
+   // each worker gets a share of the target file of roughly the same size
+   if (!m_actions.empty())
+      Parallel::run(m_targetSize, boost::bind(&PatchApplier::run, &m_actions[0], static_cast<u32>(m_actions.size()),
+         sourcePtr, patchPtr, targetPtr, _1, _2));
+
+   // target copies read data written by the other actions, so they run last and in order
+   for (vector<Action>::const_iterator i = m_actions.begin(); i != m_actions.end(); ++i)
+      if (i->command == TargetCopy)
+         for (u32 n = 0; n < i->length; n++)
+            targetPtr[i->outputOff + n] = targetPtr[i->inputOff + n];
+
+   checker.join();
+
+   bool valid = sourceCrc == m_sourceCrc && checksum(targetPtr, m_targetSize) == m_targetCrc;
+   target.close();
+
+   if (!valid)
+   {
+      boost::filesystem::remove(targetImg);
+      throw exception(("The patch doesn't match " + sourceImg).c_str());
+   }
+}
+
+/**
+* Checks whether a pair of IMG files matches the checksums stored in the patch.
+* Both files are checked at the same time.
+* @param sourceImg Path to the original IMG file.
+* @param targetImg Path to the patched IMG file.
+* @return True if both files match, false otherwise.
+*/
+bool PatchApplier::verify (const string &sourceImg, const string &targetImg) const
+{
+   u32 sourceCrc = 0, sourceLen = 0, targetCrc = 0, targetLen = 0;
+
+   boost::thread checker(boost::bind(&PatchApplier::calcChecksum, sourceImg, &sourceCrc, &sourceLen));
+   calcChecksum(targetImg, &targetCrc, &targetLen);
+   checker.join();
+
+   return sourceLen == m_sourceSize && sourceCrc == m_sourceCrc
+      && targetLen == m_targetSize && targetCrc == m_targetCrc;
+}
+
+/**
+* Calculates the CRC32 checksum used in BPS patches.
+* @param data The data to be checked.
+* @param len Length of the data (in bytes).
+* @return The checksum.
+*/
+u32 PatchApplier::checksum (const u8 *data, u32 len)
+{
+   boost::crc_32_type crc;
+   crc.process_bytes(data, len);
+
+   return crc.checksum();
+}
+
+/**
+* Decodes a variable-length number from the patch.
+* @param pos Position of the number, updated to the position right after it.
+* @return The decoded number.
+*/
+u32 PatchApplier::decodeNumber (u32 &pos) const
+{
+   const u8 *patchPtr = (const u8 *)m_patch.data();
+   u32 patchLen = static_cast<u32>(m_patch.size());
+   u32 value = 0, shift = 1;
+
+   while (pos < patchLen)
+   {
+      u8 cur = patchPtr[pos++];
+      value += (cur & 0x7f) * shift;
+
+      if (cur & 0x80) return value;
+
+      shift <<= 7;
+      value += shift;
+   }
+
+   throw exception("Unexpected end of patch data.");
+}
+
+/**
+* Reads a little-endian checksum from the patch.
+* @param pos Position of the checksum.
+* @return The checksum.
+*/
+u32 PatchApplier::readCrc (u32 pos) const
+{
+   const u8 *crcPtr = (const u8 *)m_patch.data() + pos;
+   return crcPtr[0] | crcPtr[1] << 8 | crcPtr[2] << 16 | static_cast<u32>(crcPtr[3]) << 24;
+}
+
+/**
+* Executes the patch actions starting in a share of the target file.
+* @param actions The actions, sorted by their position in the target file.
+* @param numActions Number of actions.
+* @param source The source file.
+* @param patch The patch file.
+* @param target The target file.
+* @param first Start of the share of the target file.
+* @param last End of the share.
+*/
+void PatchApplier::run (const Action *actions, u32 numActions, const u8 *source, const u8 *patch, u8 *target, u32 first, u32 last)
+{
+   const Action *begin = lower_bound(actions, actions + numActions, first, startsBefore);
+   const Action *end = lower_bound(begin, actions + numActions, last, startsBefore);
+
+   for (const Action *i = begin; i != end; ++i)
+   {
+      if (i->command == TargetRead)
+         copy(patch + i->inputOff, patch + i->inputOff + i->length, target + i->outputOff);
+      else if (i->command != TargetCopy)
+         copy(source + i->inputOff, source + i->inputOff + i->length, target + i->outputOff);
+   }
+}
+
+/**
+* Calculates the checksum of an entire file. Used by the checker threads,
+* so errors are reported through an invalid length instead of exceptions.
+*/
+void PatchApplier::calcChecksum (const string &file, u32 *result, u32 *size)
+{
+   try
+   {
+      mapped_file_source data(file);
+
+      *size = static_cast<u32>(data.size());
+      *result = checksum((const u8 *)data.data(), *size);
+   }
+   catch (...) {
+      *size = 0xffffffff;
+   }
+}
\ No newline at end of file
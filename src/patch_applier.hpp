@@ -0,0 +1,97 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef PATCHAPPLIER_HPP
+#define PATCHAPPLIER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "common.hpp"
+
+/**
+* Applies BPS patches to IMG files. Every action of the patch writes to its own
+* area of the output, so the actions are split among several threads.
+*/
+class PatchApplier
+{
+public:
+   /**
+   * Loads a patch file, checking its integrity.
+   * @param patchFile Path to the BPS patch.
+   */
+   explicit PatchApplier (const std::string &patchFile);
+
+   /**
+   * Creates the patched IMG file.
+   * @param sourceImg Path to the original IMG file.
+   * @param targetImg Path where the patched IMG file will be created.
+   */
+   void apply (const std::string &sourceImg, const std::string &targetImg);
+
+   /**
+   * Checks whether a pair of IMG files matches the checksums stored in the patch.
+   * @param sourceImg Path to the original IMG file.
+   * @param targetImg Path to the patched IMG file.
+   * @return True if both files match, false otherwise.
+   */
+   bool verify (const std::string &sourceImg, const std::string &targetImg) const;
+
+   /**
+   * Calculates the CRC32 checksum used in BPS patches.
+   * @param data The data to be checked.
+   * @param len Length of the data (in bytes).
+   * @return The checksum.
+   */
+   static u32 checksum (const u8 *data, u32 len);
+
+   u32 sourceSize () const { return m_sourceSize; }
+   u32 targetSize () const { return m_targetSize; }
+
+   enum {
+      SourceRead, /**< Copies data from the same offset in the source file */
+      TargetRead, /**< Copies data stored in the patch itself              */
+      SourceCopy, /**< Copies data from anywhere in the source file        */
+      TargetCopy  /**< Copies data already written to the target file      */
+   };
+
+private:
+   typedef struct tagFF8PatchAction {
+      int command;   /**< One of the BPS commands.                     */
+      u32 outputOff; /**< Where the data goes in the target file.      */
+      u32 length;    /**< Length of the data (in bytes).               */
+      u32 inputOff;  /**< Where the data comes from (source or patch). */
+   } Action;
+
+   u32 decodeNumber (u32 &pos) const;
+   u32 readCrc (u32 pos) const;
+
+   static bool startsBefore (const Action &action, u32 offset) { return action.outputOff < offset; }
+   static void run (const Action *actions, u32 numActions, const u8 *source, const u8 *patch, u8 *target, u32 first, u32 last);
+   static void calcChecksum (const std::string &file, u32 *result, u32 *size);
+
+   boost::iostreams::mapped_file_source m_patch; /**< The patch file.               */
+   std::vector<Action> m_actions;                /**< Decoded patch actions.        */
+
+   u32 m_sourceSize; /**< Expected length of the source file.  */
+   u32 m_targetSize; /**< Length of the target file.           */
+   u32 m_sourceCrc;  /**< Checksum of the source file.         */
+   u32 m_targetCrc;  /**< Checksum of the target file.         */
+};
+
+#endif //~PATCHAPPLIER_HPP
\ No newline at end of file
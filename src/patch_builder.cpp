@@ -0,0 +1,361 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "patch_builder.hpp"
+#include "patch_applier.hpp"
+#include "lzsdecoder.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+
+/** Multiplier of the polynomial rolling hash. */
+static const u32 HashPrime = 0x01000193;
+
+/**
+* Calculates the rolling hash of a block.
+* @param data Pointer to the block.
+* @param len Length of the block.
+* @return The hash value.
+*/
+static u32 hashBlock (const u8 *data, u32 len)
+{
+   u32 hash = 0;
+
+   for (u32 i = 0; i < len; i++)
+      hash = hash * HashPrime + data[i];
+
+   return hash;
+}
+
+/**
+* Stores the checksum of a data block. Used by the checker threads.
+*/
+static void storeChecksum (const u8 *data, u32 len, u32 *result)
+{
+   *result = PatchApplier::checksum(data, len);
+}
+
+/**
+* @param sourceImg Path to the original IMG file.
+* @param targetImg Path to the rebuilt IMG file.
+* @param secSize Size of each sector (in bytes).
+* @param discSector Sector position of the IMG file inside the disc image.
+*/
+PatchBuilder::PatchBuilder (const string &sourceImg, const string &targetImg, u16 secSize, u32 discSector) :
+   m_source(sourceImg), m_target(targetImg), m_secSize(secSize), m_discSector(discSector), m_outputPos(0), m_sourceRel(0)
+{
+   m_sourcePtr = (const u8 *)m_source.data();
+   m_targetPtr = (const u8 *)m_target.data();
+   m_sourceLen = static_cast<u32>(m_source.size());
+   m_targetLen = static_cast<u32>(m_target.size());
+}
+
+/**
+* Adds the index and every file described in the inserter info to the
+* areas that will be compared, both in their original and new positions.
+* @param info Information collected when the files were extracted.
+*/
+void PatchBuilder::addManifest (FF8InserterInfo &info)
+{
+   // the main index, including its terminator
+   addRegion(info.indexStart(), info.indexEnd() + 8, info.indexStart(), info.indexEnd() + 8);
+
+   for (FF8InserterInfo::folder_iterator i = info.begin(); i != info.end(); ++i)
+   {
+      FF8InserterFolder &folder = i->second;
+
+      LZSDecoder::filedata_type decoded;
+      const u8 *subEntries = 0;
+
+      // the new position of files from sub-indices is found in the rebuilt index file
+      if (folder.name() != "Other")
+      {
+         FF8InserterFile &idxFile = info["Other"][folder.indexFile()];
+         const u8 *idxPtr = m_targetPtr + readEntry(m_targetPtr + info.indexStart() + idxFile.id() * 8).first;
+
+         if (boost::iends_with(folder.indexFile(), ".lzs"))
+         {
+            LZSDecoder decoder(idxPtr + 4, *((u32 *)idxPtr));
+            decoded = decoder.decode();
+            idxPtr = decoded.first.get();
+         }
+
+         subEntries = idxPtr + folder.indexStart();
+      }
+
+      for (FF8InserterFolder::file_iterator j = folder.begin(); j != folder.end(); ++j)
+      {
+         FF8InserterFile &file = j->second;
+
+         pair<u32, u32> pos = subEntries ?
+            readEntry(subEntries + file.id() * 8) :
+            readEntry(m_targetPtr + info.indexStart() + file.id() * 8);
+
+         u32 sourceEnd = file.offset() + rounded(file.length());
+         addRegion(pos.first, pos.first + rounded(pos.second), file.offset(), sourceEnd);
+
+         // the original area may have been reused by another file
+         if (pos.first != file.offset())
+            addRegion(file.offset(), sourceEnd, file.offset(), sourceEnd);
+      }
+   }
+}
+
+/**
+* Adds an area of the rebuilt IMG that will be compared.
+* @param targetStart Offset of the area in the rebuilt IMG.
+* @param targetEnd End offset of the area in the rebuilt IMG.
+* @param sourceStart Offset of the matching data in the original IMG.
+* @param sourceEnd End offset of the matching data in the original IMG.
+*/
+void PatchBuilder::addRegion (u32 targetStart, u32 targetEnd, u32 sourceStart, u32 sourceEnd)
+{
+   Region region = { targetStart, min(targetEnd, m_targetLen), sourceStart, min(sourceEnd, m_sourceLen) };
+
+   if (region.targetStart < region.targetEnd)
+      m_regions.push_back(region);
+}
+
+/**
+* Encodes the patch and writes it to a file. Everything outside the compared
+* areas is copied straight from the original IMG.
+* @param patchFile Path to the patch file.
+* @return Length of the patch (in bytes).
+*/
+u32 PatchBuilder::build (const string &patchFile)
+{
+   // the checksums are calculated while the patch is encoded
+   u32 sourceCrc = 0, targetCrc = 0;
+   boost::thread sourceChecker(boost::bind(&storeChecksum, m_sourcePtr, m_sourceLen, &sourceCrc));
+   boost::thread targetChecker(boost::bind(&storeChecksum, m_targetPtr, m_targetLen, &targetCrc));
+
+   // anything past the end of the original IMG is new data
+   if (m_targetLen > m_sourceLen)
+      addRegion(m_sourceLen, m_targetLen, m_sourceLen, m_sourceLen);
+
+   sort(m_regions.begin(), m_regions.end());
+   vector<Region> merged;
+
+   for (vector<Region>::iterator i = m_regions.begin(); i != m_regions.end(); ++i)
+   {
+      if (merged.empty() || i->targetStart > merged.back().targetEnd)
+      {
+         merged.push_back(*i);
+         continue;
+      }
+
+      Region &last = merged.back();
+      last.targetEnd = max(last.targetEnd, i->targetEnd);
+      last.sourceStart = min(last.sourceStart, i->sourceStart);
+      last.sourceEnd = max(last.sourceEnd, i->sourceEnd);
+   }
+
+   const char header[] = "BPS1";
+   m_patch.assign(header, header + 4);
+
+   encodeNumber(m_sourceLen);
+   encodeNumber(m_targetLen);
+   encodeNumber(0);
+
+   for (vector<Region>::iterator i = merged.begin(); i != merged.end(); ++i)
+   {
+      sourceRead(i->targetStart - m_outputPos);
+      encodeRegion(*i);
+   }
+
+   sourceRead(m_targetLen - m_outputPos);
+
+   sourceChecker.join();
+   targetChecker.join();
+
+   encodeCrc(sourceCrc);
+   encodeCrc(targetCrc);
+   encodeCrc(PatchApplier::checksum(&m_patch[0], static_cast<u32>(m_patch.size())));
+
+   ofstream patch(patchFile.c_str(), ios::binary);
+   if (!patch) throw exception(("Unable to create " + patchFile).c_str());
+
+   patch.exceptions(ios_base::badbit);
+   patch.write((char *)&m_patch[0], m_patch.size());
+
+   return static_cast<u32>(m_patch.size());
+}
+
+/**
+* Encodes an area of the rebuilt IMG. Unchanged runs are read from the same
+* offset in the original IMG, blocks found in the original data of the area
+* are copied from there and everything else is stored in the patch.
+* @param region The area to be encoded.
+*/
+void PatchBuilder::encodeRegion (const Region &region)
+{
+   // indexes the original data in fixed-size blocks
+   blocktable_type blocks;
+
+   for (u32 pos = region.sourceStart; pos + BlockSize <= region.sourceEnd; pos += BlockSize)
+      blocks.push_back(make_pair(hashBlock(m_sourcePtr + pos, BlockSize), pos));
+
+   sort(blocks.begin(), blocks.end());
+
+   // used to roll the hash one byte forward
+   u32 outFactor = 1;
+   for (int i = 1; i < BlockSize; i++) outFactor *= HashPrime;
+
+   u32 pos = region.targetStart, literal = pos, hash = 0;
+   bool hashed = false;
+
+   while (pos < region.targetEnd)
+   {
+      u32 same = 0;
+      while (pos + same < region.targetEnd && pos + same < m_sourceLen && m_targetPtr[pos + same] == m_sourcePtr[pos + same])
+         same++;
+
+      if (same >= MinMatch || (same && pos + same == region.targetEnd))
+      {
+         targetRead(literal, pos);
+         sourceRead(same);
+
+         pos += same, literal = pos, hashed = false;
+         continue;
+      }
+
+      if (pos + BlockSize <= region.targetEnd && !blocks.empty())
+      {
+         if (!hashed) hash = hashBlock(m_targetPtr + pos, BlockSize), hashed = true;
+
+         blocktable_type::iterator i = lower_bound(blocks.begin(), blocks.end(), make_pair(hash, u32(0)));
+         u32 bestLen = 0, bestPos = 0;
+
+         for (; i != blocks.end() && i->first == hash; ++i)
+         {
+            u32 len = 0;
+            while (pos + len < region.targetEnd && i->second + len < m_sourceLen && m_targetPtr[pos + len] == m_sourcePtr[i->second + len])
+               len++;
+
+            if (len > bestLen) bestLen = len, bestPos = i->second;
+         }
+
+         if (bestLen >= BlockSize)
+         {
+            targetRead(literal, pos);
+            sourceCopy(bestPos, bestLen);
+
+            pos += bestLen, literal = pos, hashed = false;
+            continue;
+         }
+
+         if (pos + BlockSize < region.targetEnd)
+            hash = (hash - m_targetPtr[pos] * outFactor) * HashPrime + m_targetPtr[pos + BlockSize];
+         else
+            hashed = false;
+      }
+
+      pos++;
+   }
+
+   targetRead(literal, region.targetEnd);
+}
+
+/**
+* Encodes an action copying data from the same offset in the original IMG.
+* @param len Length of the data (in bytes).
+*/
+void PatchBuilder::sourceRead (u32 len)
+{
+   if (!len) return;
+
+   encodeNumber((len - 1) << 2 | PatchApplier::SourceRead);
+   m_outputPos += len;
+}
+
+/**
+* Encodes an action storing data from the rebuilt IMG into the patch.
+* @param start Offset of the data in the rebuilt IMG.
+* @param end End offset of the data in the rebuilt IMG.
+*/
+void PatchBuilder::targetRead (u32 start, u32 end)
+{
+   if (start == end) return;
+
+   encodeNumber((end - start - 1) << 2 | PatchApplier::TargetRead);
+   m_patch.insert(m_patch.end(), m_targetPtr + start, m_targetPtr + end);
+   m_outputPos += end - start;
+}
+
+/**
+* Encodes an action copying data from anywhere in the original IMG.
+* @param pos Offset of the data in the original IMG.
+* @param len Length of the data (in bytes).
+*/
+void PatchBuilder::sourceCopy (u32 pos, u32 len)
+{
+   encodeNumber((len - 1) << 2 | PatchApplier::SourceCopy);
+   encodeNumber(pos >= m_sourceRel ? (pos - m_sourceRel) << 1 : (m_sourceRel - pos) << 1 | 1);
+
+   m_sourceRel = pos + len;
+   m_outputPos += len;
+}
+
+/**
+* Encodes a number using the variable-length format of BPS patches.
+* @param value Number to be encoded.
+*/
+void PatchBuilder::encodeNumber (u32 value)
+{
+   for (;;)
+   {
+      u8 cur = value & 0x7f;
+      value >>= 7;
+
+      if (!value)
+      {
+         m_patch.push_back(0x80 | cur);
+         break;
+      }
+
+      m_patch.push_back(cur);
+      value--;
+   }
+}
+
+/**
+* Stores a checksum in little-endian order.
+* @param crc The checksum.
+*/
+void PatchBuilder::encodeCrc (u32 crc)
+{
+   for (int i = 0; i < 4; i++)
+      m_patch.push_back(static_cast<u8>(crc >> i * 8));
+}
+
+/**
+* Reads an index entry, converting it into an offset inside the IMG.
+* @param entry Pointer to the entry.
+* @return A pair containing the offset and the length of the file.
+*/
+pair<u32, u32> PatchBuilder::readEntry (const u8 *entry) const
+{
+   const u32 *cur = (const u32 *)entry;
+   return make_pair((cur[0] - m_discSector) * m_secSize, cur[1]);
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef PATCHBUILDER_HPP
+#define PATCHBUILDER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "common.hpp"
+#include "insertinfo.hpp"
+
+/**
+* Creates BPS patches between an original and a rebuilt IMG file. Instead of
+* comparing both files entirely, only the index and the areas of the files
+* described in the inserter info are compared. Changed files are encoded
+* with a rolling-hash block matcher against their original contents.
+*/
+class PatchBuilder
+{
+public:
+   /**
+   * @param sourceImg Path to the original IMG file.
+   * @param targetImg Path to the rebuilt IMG file.
+   * @param secSize Size of each sector (in bytes).
+   * @param discSector Sector position of the IMG file inside the disc image.
+   */
+   PatchBuilder (const std::string &sourceImg, const std::string &targetImg, u16 secSize, u32 discSector);
+
+   /**
+   * Adds the index and every file described in the inserter info to the
+   * areas that will be compared, both in their original and new positions.
+   * @param info Information collected when the files were extracted.
+   */
+   void addManifest (FF8InserterInfo &info);
+
+   /**
+   * Adds an area of the rebuilt IMG that will be compared.
+   * @param targetStart Offset of the area in the rebuilt IMG.
+   * @param targetEnd End offset of the area in the rebuilt IMG.
+   * @param sourceStart Offset of the matching data in the original IMG.
+   * @param sourceEnd End offset of the matching data in the original IMG.
+   */
+   void addRegion (u32 targetStart, u32 targetEnd, u32 sourceStart, u32 sourceEnd);
+
+   /**
+   * Encodes the patch and writes it to a file.
+   * @param patchFile Path to the patch file.
+   * @return Length of the patch (in bytes).
+   */
+   u32 build (const std::string &patchFile);
+
+private:
+   typedef struct tagFF8PatchRegion {
+      bool operator< (const tagFF8PatchRegion &r) const { return targetStart < r.targetStart; }
+
+      u32 targetStart, targetEnd; /**< Area in the rebuilt IMG.        */
+      u32 sourceStart, sourceEnd; /**< Where to look for matching data. */
+   } Region;
+
+   enum {
+      BlockSize = 32, /**< Size of the blocks indexed by the matcher           */
+      MinMatch = 16   /**< Unchanged runs shorter than this are stored as-is   */
+   };
+
+   typedef std::vector<std::pair<u32, u32> > blocktable_type;
+
+   void encodeRegion (const Region &region);
+   void sourceRead (u32 len);
+   void targetRead (u32 start, u32 end);
+   void sourceCopy (u32 pos, u32 len);
+   void encodeNumber (u32 value);
+   void encodeCrc (u32 crc);
+
+   std::pair<u32, u32> readEntry (const u8 *entry) const;
+   u32 rounded (u32 len) const { return (len + m_secSize - 1) / m_secSize * m_secSize; }
+
+   boost::iostreams::mapped_file_source m_source; /**< Original IMG. */
+   boost::iostreams::mapped_file_source m_target; /**< Rebuilt IMG.  */
+
+   const u8 *m_sourcePtr, *m_targetPtr;
+   u32 m_sourceLen, m_targetLen;
+
+   u16 m_secSize;            /**< Size of each sector (in bytes).                    */
+   u32 m_discSector;         /**< Sector position of the IMG inside the disc image. */
+
+   std::vector<Region> m_regions; /**< Areas of the rebuilt IMG to be compared.  */
+   std::vector<u8> m_patch;       /**< The encoded patch.                        */
+   u32 m_outputPos;               /**< Bytes of the target encoded so far.       */
+   u32 m_sourceRel;               /**< Base offset for the next source copy.     */
+};
+
+#endif //~PATCHBUILDER_HPP
\ No newline at end of file
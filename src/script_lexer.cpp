@@ -0,0 +1,218 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "script_lexer.hpp"
+
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <exception>
+#include <cctype>
+#include <cstdlib>
+
+using namespace std;
+
+/** Number of dashes in the line separating the blocks. */
+static const int SeparatorDashes = 33;
+
+/** Characters that end a piece of text. */
+static const char Delimiters[] = "\n[]";
+
+/**
+* Reads the next token. Stray closing brackets are skipped.
+* @param token Where the token is stored.
+* @return False once the end of the script is reached (the token is End).
+*/
+bool ScriptLexer::next (Token &token)
+{
+   token.codeLen = 0;
+   token.shared = -1;
+
+   while (m_pos != m_last && *m_pos == ']') m_pos++;
+
+   token.first = m_pos;
+
+   if (m_pos == m_last)
+   {
+      token.type = End;
+      token.last = m_last;
+      return false;
+   }
+
+   // a block may start with its record, which takes the whole line
+   if (m_blockStart)
+   {
+      m_blockStart = false;
+
+      if (m_last - m_pos >= 3 && equal(m_pos, m_pos + 3, "@@ "))
+      {
+         const char *eol = find(m_pos, m_last, '\n');
+
+         token.type = Record;
+         token.last = eol;
+         m_pos = eol == m_last ? eol : eol + 1;
+
+         return true;
+      }
+   }
+
+   if (*m_pos == '\n')
+   {
+      int shared;
+      const char *after = separator(m_pos, token.shared);
+
+      if (after)
+      {
+         token.type = BlockEnd;
+         m_blockStart = true;
+         m_pos = after;
+      }
+      // the third line break can't be the start of a separator
+      else if (m_newsessions && m_last - m_pos >= 3 && m_pos[1] == '\n' && m_pos[2] == '\n' && !separator(m_pos + 2, shared))
+      {
+         token.type = NewSession;
+         m_pos += 3;
+      }
+      else
+      {
+         token.type = NewLine;
+         m_pos++;
+      }
+
+      token.last = m_pos;
+   }
+   else if (*m_pos == '[')
+   {
+      const char *close = find(m_pos + 1, m_last, ']');
+      if (close == m_last) throw exception(("Missing ] after " + string(m_pos, min<ptrdiff_t>(m_last - m_pos, 16))).c_str());
+
+      code(m_pos + 1, close, token);
+      m_pos = close + 1;
+   }
+   else
+   {
+      token.type = Text;
+      m_pos = find_first_of(m_pos, m_last, Delimiters, Delimiters + 3);
+      token.last = m_pos;
+   }
+
+   return true;
+}
+
+/**
+* Finds where the current block ends, without reading its tokens.
+* @return Position of the separator ending the block (or the end of the script).
+*/
+const char *ScriptLexer::blockEnd () const
+{
+   int shared;
+
+   for (const char *i = m_pos; (i = find(i, m_last, '\n')) != m_last; ++i)
+      if (separator(i, shared)) return i;
+
+   return m_last;
+}
+
+/**
+* Checks whether a block separator starts at the given line break.
+* @param pos Position of the line break.
+* @param shared Set to the block shared, if the separator says so (-1 if not).
+* @return Position after the separator, null if there's none.
+*/
+const char *ScriptLexer::separator (const char *pos, int &shared) const
+{
+   const char *dashes = pos + 1, *end = dashes + SeparatorDashes;
+
+   if (m_last - dashes <= SeparatorDashes || *dashes != '-') return 0;
+   if (find_if(dashes, end, bind2nd(not_equal_to<char>(), '-')) != end) return 0;
+
+   shared = -1;
+   if (*end == '\n') return end + 1;
+
+   static const char tag[] = " shared:";
+   const char *digits = end + sizeof(tag) - 1, *i = digits;
+
+   if (m_last - end < static_cast<ptrdiff_t>(sizeof(tag)) || !equal(tag, tag + sizeof(tag) - 1, end)) return 0;
+
+   while (i != m_last && isdigit(static_cast<u8>(*i))) i++;
+   if (i == digits || i == m_last || *i != '\n') return 0;
+
+   shared = atoi(string(digits, i).c_str());
+   return i + 1;
+}
+
+/**
+* Looks up the code found between brackets. Hex values ($XX or $XXXX) are
+* used as they are; anything else must be in the table, unless it has
+* characters a code can't have, when it's kept as text (without the brackets).
+* @param first Start of the code.
+* @param last End of the code.
+* @param token Where the code is stored.
+*/
+void ScriptLexer::code (const char *first, const char *last, Token &token) const
+{
+   token.first = first;
+   token.last = last;
+   token.type = Code;
+
+   if (first != last && *first == '$')
+   {
+      string hex(first + 1, last);
+
+      if (hex.size() == 2)
+      {
+         token.code[0] = hexDecode<u8>(hex);
+         token.codeLen = 1;
+      }
+      else
+      {
+         u16 value = hexDecode<u16>(hex);
+         token.code[0] = value >> 8;
+         token.code[1] = value & 0xff;
+         token.codeLen = 2;
+      }
+
+      return;
+   }
+
+   string name(first, last);
+
+   if (m_tbl.exists<u16>(name))
+   {
+      u16 value = m_tbl.find<u16>(name);
+      token.code[0] = value >> 8;
+      token.code[1] = value & 0xff;
+      token.codeLen = 2;
+   }
+   else if (m_tbl.exists<u8>(name))
+   {
+      token.code[0] = m_tbl.find<u8>(name);
+      token.codeLen = 1;
+   }
+   else
+   {
+      bool isName = !name.empty();
+
+      for (string::iterator i = name.begin(); isName && i != name.end(); ++i)
+         isName = isalnum(static_cast<u8>(*i)) || isspace(static_cast<u8>(*i)) || *i == '_' || *i == '?';
+
+      if (isName) throw exception(("Invalid code found: " + name).c_str());
+
+      token.type = Text;
+   }
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef SCRIPTLEXER_HPP
+#define SCRIPTLEXER_HPP
+
+#include "common.hpp"
+#include "dictionary.hpp"
+
+/**
+* Splits a script into tokens in a single pass over its text, which is
+* never copied. Codes are looked up in the table as soon as they're found,
+* so only the text between them is left to be encoded.
+*/
+class ScriptLexer
+{
+public:
+   enum {
+      Text,       /**< Text without any codes or line breaks.       */
+      Code,       /**< A code in brackets, already looked up.       */
+      NewLine,    /**< A line break (0x02).                         */
+      NewSession, /**< Three line breaks in a row (0x01).           */
+      Record,     /**< Record found at the start of a block.        */
+      BlockEnd,   /**< Separator found at the end of a block.       */
+      End         /**< End of the script.                           */
+   };
+
+   /** A piece of the script */
+   typedef struct tagFF8ScriptToken {
+      int type;          /**< What the token is.                         */
+      const char *first; /**< Start of its text.                         */
+      const char *last;  /**< End of its text.                           */
+      u8 code[2];        /**< Bytes of a code.                           */
+      u32 codeLen;       /**< Number of bytes of a code.                 */
+      int shared;        /**< Block shared by a block end (-1 if none).  */
+   } Token;
+
+   /**
+   * Starts reading a script.
+   * @param dic Table used to look up the codes.
+   * @param first Start of the script.
+   * @param last End of the script.
+   * @param newsessions Whether three line breaks in a row start a new session.
+   */
+   ScriptLexer (const Dictionary &dic, const char *first, const char *last, bool newsessions) :
+      m_tbl(dic), m_pos(first), m_last(last), m_newsessions(newsessions), m_blockStart(true) { }
+
+   bool next (Token &token);
+
+   const char *blockEnd () const;
+
+   /**
+   * Moves to a position found by blockEnd, skipping the rest of the block.
+   * @param pos The new position.
+   */
+   void seek (const char *pos) { m_pos = pos; m_blockStart = false; }
+
+   /**
+   * Gets the position of the next token.
+   * @return Where the next token starts.
+   */
+   const char *position () const { return m_pos; }
+
+   /**
+   * Checks whether three line breaks in a row start a new session.
+   * @return True if new sessions are recognized.
+   */
+   bool newsessions () const { return m_newsessions; }
+
+private:
+   const char *separator (const char *pos, int &shared) const;
+   void code (const char *first, const char *last, Token &token) const;
+
+   const Dictionary &m_tbl; /**< Table used to look up the codes.           */
+   const char *m_pos;       /**< Where the next token starts.                */
+   const char *m_last;      /**< End of the script.                          */
+   bool m_newsessions;      /**< Whether new sessions are recognized.        */
+   bool m_blockStart;       /**< Whether the next token starts a block.      */
+};
+
+#endif //~SCRIPTLEXER_HPP
\ No newline at end of file
@@ -0,0 +1,147 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef SCRIPTSINK_HPP
+#define SCRIPTSINK_HPP
+
+#include <string>
+#include <fstream>
+#include <exception>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem.hpp>
+#include "common.hpp"
+
+/**
+* Destination of a script being dumped. The text is written a whole
+* block at a time, as soon as each block is decoded.
+*/
+class ScriptSink : boost::noncopyable
+{
+public:
+   virtual ~ScriptSink () { }
+
+   /**
+   * Writes a piece of the script.
+   * @param data The text.
+   * @param len Length of the text.
+   */
+   virtual void write (const char *data, u32 len) = 0;
+
+   /**
+   * Hints how much text is about to be written.
+   * @param len Expected length of the text.
+   */
+   virtual void expect (u32 /*len*/) { }
+};
+
+/**
+* Appends the script to a string.
+*/
+class StringSink : public ScriptSink
+{
+public:
+   explicit StringSink (std::string &dest) : m_dest(dest) { }
+
+   void write (const char *data, u32 len) { m_dest.append(data, len); }
+   void expect (u32 len) { m_dest.reserve(m_dest.size() + len); }
+
+private:
+   std::string &m_dest; /**< String where the script is appended. */
+};
+
+/**
+* Writes the script into a text file, in large chunks. The text goes to a
+* temporary file next to it, which only replaces the script once commit is
+* called, so a dump that fails halfway leaves the old script as it was.
+*/
+class FileSink : public ScriptSink
+{
+public:
+   enum {
+      BufferSize = 0x10000 /**< Text kept before each write */
+   };
+
+   /**
+   * @param fileName Path of the file, which is created (or replaced) by commit.
+   */
+   explicit FileSink (const std::string &fileName) :
+      m_fileName(fileName), m_tempName(fileName + ".tmp"), m_file(m_tempName.c_str())
+   {
+      if (!m_file) throw std::exception(("Unable to create " + fileName).c_str());
+      m_buffer.reserve(BufferSize);
+   }
+
+   /** The temporary file is thrown away unless the script was committed. */
+   ~FileSink ()
+   {
+      if (!m_file.is_open()) return;
+
+      boost::system::error_code error;
+      m_file.close();
+      boost::filesystem::remove(m_tempName, error);
+   }
+
+   void write (const char *data, u32 len)
+   {
+      m_buffer.append(data, len);
+      if (m_buffer.size() >= BufferSize) flush();
+   }
+
+   void flush ()
+   {
+      m_file.write(m_buffer.data(), m_buffer.size());
+      m_buffer.clear();
+   }
+
+   /**
+   * Replaces the script with the text written so far, once the dump is over.
+   */
+   void commit ()
+   {
+      flush();
+      m_file.close();
+
+      if (!m_file) throw std::exception(("Unable to write " + m_fileName).c_str());
+      boost::filesystem::rename(m_tempName, m_fileName);
+   }
+
+private:
+   std::string m_fileName; /**< Path of the script.                */
+   std::string m_tempName; /**< Path of the temporary file.        */
+   std::ofstream m_file;   /**< The temporary file.                */
+   std::string m_buffer;   /**< Text not written to the file yet.  */
+};
+
+/**
+* Hands each piece of the script to a function.
+*/
+class CallbackSink : public ScriptSink
+{
+public:
+   typedef boost::function<void (const char *, u32)> callback_type;
+
+   explicit CallbackSink (const callback_type &callback) : m_callback(callback) { }
+
+   void write (const char *data, u32 len) { m_callback(data, len); }
+
+private:
+   callback_type m_callback; /**< Function receiving the text. */
+};
+
+#endif //~SCRIPTSINK_HPP
\ No newline at end of file
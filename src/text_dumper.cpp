@@ -18,9 +18,13 @@
 
 #include "text_dumper.hpp"
 #include "data_structure.hpp"
+#include "parallel.hpp"
 
 #include <map>
-#include <sstream>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
 #include <algorithm>
 #include <exception>
 
@@ -28,65 +32,226 @@ using namespace std;
 
 /**
 * Manages the dump process, forwarding the data to the apropriate dump method.
-* @param result String where the text script will be written to.
+* @param result String where the text script will be written to (using the first table).
 * @param type The type of file to dump from.
 * @param ptrOff Offset of the pointers table (optional).
 * @param txtOff Offset of the text data (optional).
 */
 void TextDumper::dump(string &result, int type, u32 ptrOff, u32 txtOff)
 {
-   switch (type)
+   StringSink sink(result);
+   dump(sink, type, ptrOff, txtOff);
+}
+
+/**
+* Dumps the scripts of all the tables into strings.
+* @param results Strings where the text scripts will be written to, one per table.
+* @param type The type of file to dump from.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the text data (optional).
+*/
+void TextDumper::dump(vector<string> &results, int type, u32 ptrOff, u32 txtOff)
+{
+   results.resize(m_tbls.size());
+
+   vector<boost::shared_ptr<StringSink> > strings;
+   sinks_type sinks;
+
+   for (vector<string>::iterator i = results.begin(); i != results.end(); ++i)
    {
-      case Battle:
-         dumpFromBattleScene(result);
-         break;
+      strings.push_back(boost::shared_ptr<StringSink>(new StringSink(*i)));
+      sinks.push_back(strings.back().get());
+   }
 
-      case Field:
-         dumpFromFieldDialogs(result);
-         break;
+   dump(sinks, type, ptrOff, txtOff);
+}
 
-      case Linear:
-         dumpFromLinearData(result, ptrOff);
-         break;
+/**
+* Dumps the script of the first table into a sink.
+* @param sink Where the text script will be written to.
+* @param type The type of file to dump from.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the text data (optional).
+*/
+void TextDumper::dump(ScriptSink &sink, int type, u32 ptrOff, u32 txtOff)
+{
+   sinks_type sinks(m_tbls.size(), 0);
+   sinks.front() = &sink;
 
-      case Packed:
-         dumpFromPackedData(result, ptrOff);
-         break;
+   dump(sinks, type, ptrOff, txtOff);
+}
 
-      case SeedTest:
-         dumpFromLinearData(result, ptrOff, true);
-         break;
+/**
+* Manages the dump process for all the tables at once. The pointers are only
+* walked once, each block being translated with every table and written to
+* its sink right away.
+* @param result Where the text scripts will be written to, one per table
+*               (null for the tables whose script isn't wanted).
+* @param type The type of file to dump from.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the text data (optional).
+*/
+void TextDumper::dump(const sinks_type &result, int type, u32 ptrOff, u32 txtOff)
+{
+   if (result.size() != m_tbls.size())
+      throw exception("TextDumper needs one script for each table.");
 
-      case Refines:
-         dumpFromRefinesData(result, ptrOff, txtOff);
-         break;
+   int block = 0;
+
+   if (type == MenuBattle)
+   {
+      if (!m_ptrdesc.isLoaded()) m_ptrdesc.loadFromFile("battle-module.xml");
 
-      case MenuHelp:
-         dumpFromMenuHelpData(result, ptrOff, txtOff);
-         break;
+      map<u32, int> blocks = menuBattleBlocks();
+      if (!blocks.count(txtOff)) throw exception("The text data isn't listed in the battle module.");
+
+      block = blocks[txtOff];
+   }
+
+   dumpSection(result, type, ptrOff, txtOff, block);
+}
+
+/**
+* Dumps several sections of the file at once. Whatever the sections have
+* in common is only looked up once, then they're split between several
+* threads. An error in one section doesn't stop the others.
+* @param sections The sections, whose scripts and codes used are filled.
+*/
+void TextDumper::dump(vector<Section> &sections)
+{
+   if (sections.empty()) return;
 
-      case MenuBattle:
+   vector<int> blocks(sections.size(), 0);
+   map<u32, int> menuBlocks;
+
+   for (u32 i = 0; i < sections.size(); i++)
+   {
+      if (sections[i].sinks.size() != m_tbls.size())
+         throw exception("TextDumper needs one script for each table.");
+
+      if (sections[i].type != MenuBattle) continue;
+
+      if (menuBlocks.empty())
+      {
          if (!m_ptrdesc.isLoaded()) m_ptrdesc.loadFromFile("battle-module.xml");
-         dumpFromMenuBattleData(result, ptrOff, txtOff);
-         break;
+         menuBlocks = menuBattleBlocks();
+      }
+
+      // the section fails alone, when its dump starts
+      blocks[i] = menuBlocks.count(sections[i].txtOff) ? menuBlocks[sections[i].txtOff] : -1;
+   }
+
+   Parallel::run(static_cast<u32>(sections.size()), boost::bind(&TextDumper::dumpRange, this, &sections[0], &blocks[0], _1, _2));
+}
+
+/**
+* Dumps a share of the sections.
+* @param sections The sections.
+* @param blocks Pointer description of each MenuBattle section (-1 if unknown).
+* @param first First section of the share.
+* @param last Section after the last one.
+*/
+void TextDumper::dumpRange (Section *sections, const int *blocks, u32 first, u32 last) const
+{
+   // each share gets a copy of the dumper, since blocks are translated into a member buffer
+   TextDumper worker(*this);
+
+   for (u32 i = first; i < last; i++)
+   {
+      try
+      {
+         if (blocks[i] < 0) throw exception("The text data isn't listed in the battle module.");
 
-      case MainMenu:
-         dumpFromMainMenuData(result, ptrOff);
-         break;
+         worker.dumpSection(sections[i].sinks, sections[i].type, sections[i].ptrOff, sections[i].txtOff, blocks[i]);
+         sections[i].usage = worker.m_usage;
+      }
+      catch (const exception &e) {
+         sections[i].error = e.what();
+      }
+   }
+}
+
+/**
+* Maps the text offset of each block of the battle module to the pointer
+* description used by it, from the table at 0x80.
+* @return Number of the pointer description of each text offset.
+*/
+map<u32, int> TextDumper::menuBattleBlocks () const
+{
+   const u32 *txttbl = (const u32 *)(m_data.first.get() + 0x80);
+   map<u32, int> result;
+
+   // the first block wins when several share the same text offset
+   for (int i = 0; i < 25; i++)
+      result.insert(make_pair(txttbl[i], i + 1));
 
-      default:
-         throw exception("TextDumper is unable to dump from the specified file type.");
+   return result;
+}
+
+/** Forwards a section to the dump method of its format. */
+struct TextDumper::SectionDump
+{
+   SectionDump (TextDumper &d, const sinks_type &r, u32 p, u32 t, int b) :
+      dumper(d), result(r), ptrOff(p), txtOff(t), block(b) { }
+
+   template <class Format> void operator() (Format) {
+      dumper.dumpAs<Format>(result, ptrOff, txtOff, block);
    }
+
+   TextDumper &dumper;
+   const sinks_type &result;
+   u32 ptrOff, txtOff;
+   int block;
+};
+
+/**
+* Forwards the data to the apropriate dump method.
+* @param result Where the text scripts will be written to, one per table.
+* @param type The type of file to dump from.
+* @param ptrOff Offset of the pointers table.
+* @param txtOff Offset of the text data.
+* @param block Pointer description used by MenuBattle files.
+*/
+void TextDumper::dumpSection (const sinks_type &result, int type, u32 ptrOff, u32 txtOff, int block)
+{
+   SectionDump section(*this, result, ptrOff, txtOff, block);
+   TextFormat::visit(type, section);
+}
+
+/**
+* Dumps a section whose format is known at compile time.
+* @param result Where the text scripts will be written to, one per table.
+* @param ptrOff Offset of the pointers table.
+* @param txtOff Offset of the text data.
+* @param block Pointer description used by MenuBattle files.
+*/
+template <class Format> void TextDumper::dumpAs (const sinks_type &result, u32 ptrOff, u32 txtOff, int block)
+{
+   // blocks without a pointer of their own are dumped as usual, without records
+   m_recording = m_records && Format::OwnPointers;
+
+   m_usage.clear();
+   m_shared.clear();
+
+   m_sharing = Format::Sharing;
+   m_numBlocks = 0;
+
+   // most of the file is usually text, so its size is a good guess for the script
+   for (sinks_type::const_iterator i = result.begin(); i != result.end(); ++i)
+      if (*i) (*i)->expect(m_data.second);
+
+   dumpFrom(Format(), result, ptrOff, txtOff, block);
 }
 
 /**
 * Dumps text data in a readable format from .dat files, which
 * includes the dialogues found inside battle scenes.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 */
-void TextDumper::dumpFromBattleScene (string &result)
+void TextDumper::dumpFromBattleScene (const sinks_type &result)
 {
    typedef FieldBattleTextSectionHeader TextSectionHeader;
+   typedef FormatTraits<Battle>::pointer_type pointer_type;
    u8 *dataPtr = m_data.first.get();
    u32 dataLen = m_data.second;
 
@@ -110,25 +275,25 @@ void TextDumper::dumpFromBattleScene (string &result)
 
    const u32 off_ptrtbl = header->ptr_battlescript + txtheader->text_ptrtbl;
    const u32 off_txtdata = header->ptr_battlescript + txtheader->text_data;
-   const u32 num_ptr = (off_txtdata - off_ptrtbl) / 2;
+   const u32 num_ptr = (off_txtdata - off_ptrtbl) / sizeof(pointer_type);
 
    for (u32 i = 0; i < num_ptr; i++)
    {
-      u16 *cur = (u16 *)(dataPtr + off_ptrtbl + i * 2);
+      pointer_type *cur = (pointer_type *)(dataPtr + off_ptrtbl + i * sizeof(pointer_type));
       const u8 *block_start = dataPtr + off_txtdata + *cur;
 
-      string encBlock = translateBlock(block_start);
-      result.append(encBlock);
+      translateBlock(block_start, result, (u8 *)cur, sizeof(*cur), dataPtr + off_txtdata);
    }
 }
 
 /**
 * Dumps text data in a readable format from .msd files, which
 * includes the dialogues found outside battles thorugh all the game.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 */
-void TextDumper::dumpFromFieldDialogs (string &result)
+void TextDumper::dumpFromFieldDialogs (const sinks_type &result)
 {
+   typedef FormatTraits<Field>::pointer_type pointer_type;
    u8 *dataPtr = m_data.first.get();
    FieldDialogsHeader header;
 
@@ -139,26 +304,25 @@ void TextDumper::dumpFromFieldDialogs (string &result)
    if (header.ptr_textdata == header.ptr_section9)
       throw exception("There is no text data to be dumped.");
 
-   u32 num_ptr = *((u32 *)(dataPtr + header.ptr_textdata)) / 4;
+   u32 num_ptr = *((pointer_type *)(dataPtr + header.ptr_textdata)) / sizeof(pointer_type);
 
    for (u32 i = 0; i < num_ptr; i++)
    {
-      u32 *cur = (u32 *)(dataPtr + header.ptr_textdata + i * 4);
+      pointer_type *cur = (pointer_type *)(dataPtr + header.ptr_textdata + i * sizeof(pointer_type));
       const u8 *block_start = dataPtr + header.ptr_textdata + *cur;
 
-      string encBlock = translateBlock(block_start);
-      result.append(encBlock);
+      translateBlock(block_start, result, (u8 *)cur, sizeof(*cur), dataPtr + header.ptr_textdata);
    }
 }
 
 /**
 * Dumps text data in a readable format from linear data files, which
 * includes files from various modules and various purposes.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 * @param seedTest Flag to make it work with SeeD Test files.
 */
-void TextDumper::dumpFromLinearData (string &result, u32 ptrOff, bool seedTest)
+void TextDumper::dumpFromLinearData (const sinks_type &result, u32 ptrOff, bool seedTest)
 {
    u8 *dataPtr = m_data.first.get() + ptrOff;
    u16 num_ptr = *((u16 *)dataPtr);
@@ -171,22 +335,26 @@ void TextDumper::dumpFromLinearData (string &result, u32 ptrOff, bool seedTest)
       // in seedtest files, encodes the answer to one of the questions
       if (seedTest)
       {
-         result.append("[" + hexEncode<u8>(*block_start) + "]");
+         string answer = "[" + hexEncode<u8>(*block_start) + "]";
+
+         for (sinks_type::const_iterator j = result.begin(); j != result.end(); ++j)
+            if (*j) (*j)->write(answer.data(), static_cast<u32>(answer.size()));
+
          block_start++;
       }
 
-      string encBlock = translateBlock(block_start);
-      result.append(encBlock);
+      // the pointer of a seedtest block points to the answer, not to the text
+      translateBlock(block_start, result, seedTest ? 0 : (u8 *)cur, sizeof(*cur), dataPtr);
    }
 }
 
 /**
 * Dumps text data in a readable format from packed files, which are
 * made of one or more subsessions spread through all the file.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 */
-void TextDumper::dumpFromPackedData (string &result, u32 ptrOff)
+void TextDumper::dumpFromPackedData (const sinks_type &result, u32 ptrOff)
 {
    u8 *dataPtr = m_data.first.get() + ptrOff;
    PackedMenuHeader *header = (PackedMenuHeader *)dataPtr;
@@ -197,6 +365,9 @@ void TextDumper::dumpFromPackedData (string &result, u32 ptrOff)
       if (*curBlock == 0x0000) continue;
       u16 num_ptr = *(dataPtr + *curBlock);
 
+      // pointers are relative to each block, so the text can't be shared between blocks
+      m_shared.clear();
+
       for (u32 i = 0; i < num_ptr; i++)
       {
          u16 *cur = (u16 *)(dataPtr + *curBlock + 2 + i * 2);
@@ -205,8 +376,7 @@ void TextDumper::dumpFromPackedData (string &result, u32 ptrOff)
          {
             const u8 *block_start = dataPtr + *curBlock + *cur;
 
-            string encBlock = translateBlock(block_start);
-            result.append(encBlock);
+            translateBlock(block_start, result, (u8 *)cur, sizeof(*cur), dataPtr + *curBlock);
          }
       }
    }
@@ -215,11 +385,11 @@ void TextDumper::dumpFromPackedData (string &result, u32 ptrOff)
 /**
 * Dumps text data in a readable format from files with recipes for Refines.
 * These files store the pointers table apart from the text data.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 * @param txtOff Offset of the text data.
 */
-void TextDumper::dumpFromRefinesData (string &result, u32 ptrOff, u32 txtOff)
+void TextDumper::dumpFromRefinesData (const sinks_type &result, u32 ptrOff, u32 txtOff)
 {
    u8 *pointersPtr = m_data.first.get() + ptrOff;
    u8 *textPtr = m_data.first.get() + txtOff;
@@ -228,8 +398,7 @@ void TextDumper::dumpFromRefinesData (string &result, u32 ptrOff, u32 txtOff)
 
    for (; ptr->unknown1 && ptr->unknown2 && ptr->unknown3; ptr++)
    {
-      string encBlock = translateBlock(textPtr + ptr->text_start);
-      result.append(encBlock);
+      translateBlock(textPtr + ptr->text_start, result, (u8 *)&ptr->text_start, sizeof(ptr->text_start), textPtr);
    }
 }
 
@@ -237,11 +406,11 @@ void TextDumper::dumpFromRefinesData (string &result, u32 ptrOff, u32 txtOff)
 * Dumps text data in a readable format from files containing the Tutorial
 * section of the main menu. These files share the same pointers table, but
 * store the text data in separate blocks.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 * @param txtOff Offset of the text data.
 */
-void TextDumper::dumpFromMenuHelpData (string &result, u32 ptrOff, u32 txtOff)
+void TextDumper::dumpFromMenuHelpData (const sinks_type &result, u32 ptrOff, u32 txtOff)
 {
    u8 *pointersPtr = m_data.first.get() + ptrOff;
    u8 *textPtr = m_data.first.get() + txtOff;
@@ -257,11 +426,8 @@ void TextDumper::dumpFromMenuHelpData (string &result, u32 ptrOff, u32 txtOff)
       // block starts after the title (which ends in 0x00, but didn't get its own pointer)
       const u8 *block_start = find(curBlock + sizeof(*flags), curBlock + flags->block_size, 0x00) + 1;
 
-      string encTitle = translateBlock(curBlock + sizeof(*flags));
-      string encBlock = translateBlock(block_start);
-
-      result.append(encTitle);
-      result.append(encBlock);
+      translateBlock(curBlock + sizeof(*flags), result);
+      translateBlock(block_start, result);
    }
 
 }
@@ -270,23 +436,16 @@ void TextDumper::dumpFromMenuHelpData (string &result, u32 ptrOff, u32 txtOff)
 * Dumps text data in a readable format from the battle module file, which
 * uses different structures to represent the pointers of each one of its
 * 25 blocks. The dumping relies on data from a XML files.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 * @param txtOff Offset of the text data.
+* @param n Pointer description used by this block (see menuBattleBlocks).
 */
-void TextDumper::dumpFromMenuBattleData (string &result, u32 ptrOff, u32 txtOff)
+void TextDumper::dumpFromMenuBattleData (const sinks_type &result, u32 ptrOff, u32 txtOff, int n)
 {
-   u8 *dataPtr = m_data.first.get();
    u8 *pointersPtr = m_data.first.get() + ptrOff;
    u8 *textPtr = m_data.first.get() + txtOff;
 
-   // find out where the text offset of this block is located inside the pointers table
-   u32 *txttbl = (u32 *)(dataPtr + 0x80);
-   u32 *curtbl = find(txttbl, txttbl + 25, txtOff);
-
-   // figure out which pointer description should be used
-   int n = static_cast<int> (distance(txttbl, curtbl) + 1);
-
    // iterate through the pointer blocks and extract the text pointed by valid ones
    for (int i = 0; i < m_ptrdesc[n].m_count; i++)
    {
@@ -294,54 +453,155 @@ void TextDumper::dumpFromMenuBattleData (string &result, u32 ptrOff, u32 txtOff)
 
       for (int p = 0; p < m_ptrdesc[n].m_group && *(cur + p) != 0xffff; p++)
       {
-         string encBlock = translateBlock(textPtr + *(cur + p));
-         result.append(encBlock);
+         translateBlock(textPtr + *(cur + p), result, (u8 *)(cur + p), sizeof(*cur), textPtr);
       }
    }
 }
 
 /**
 * Dumps text data in a readable format from the main menu entries data.
-* @param result String where the text script will be written to.
+* @param result Where the text scripts will be written to, one per table.
 * @param ptrOff Offset of the pointers table.
 */
-void TextDumper::dumpFromMainMenuData (string &result, u32 ptrOff)
+void TextDumper::dumpFromMainMenuData (const sinks_type &result, u32 ptrOff)
 {
    u8 *dataPtr = m_data.first.get() + ptrOff;
    u16 num_ptr = *((u16 *)dataPtr);
 
    for (u16 *cur = (u16 *)dataPtr + 1; cur != (u16 *)dataPtr + 1 + num_ptr; cur++)
-      if (*cur) result.append(translateBlock(dataPtr + *cur));
+      if (*cur) translateBlock(dataPtr + *cur, result, (u8 *)cur, sizeof(*cur), dataPtr);
+}
+
+/** Text of the control codes, the same with any table. */
+static const DictionaryView::Fragment NewSession = { "\n\n\n", 3 };
+static const DictionaryView::Fragment NewLine = { "\n", 1 };
+static const string BlockSeparator = "\n" + string(33, '-') + "\n";
+
+static bool isMte (u8 value) {
+   return value >= DictionaryView::FirstMte && value <= DictionaryView::LastMte;
 }
 
 /**
-* Translates a binary block from FF8 files into a readable text script.
+* Copies the text of every single byte from each table, replacing the
+* control codes, so a byte can be decoded with a single lookup.
+*/
+void TextDumper::compile ()
+{
+   for (tables_type::const_iterator i = m_tbls.begin(); i != m_tbls.end(); ++i)
+   {
+      const DictionaryView &view = (*i)->view();
+
+      for (u32 b = 0; b < 256; b++)
+         m_bytes.push_back(view.byte(static_cast<u8>(b)));
+
+      m_bytes[m_bytes.size() - 256 + 0x01] = NewSession;
+      m_bytes[m_bytes.size() - 256 + 0x02] = NewLine;
+   }
+}
+
+/**
+* Finds the 0x00 ending a block, marking the codes used along the way.
+* The second byte of a multi-byte code may be 0x00 too, so when a code
+* is cut short by the terminator found, the search goes on after it.
 * @param data A pointer into the location of the given block.
-* @return The readable text script generated.
+* @return A pointer to the end of the block.
 */
-string TextDumper::translateBlock (const u8 *data)
+const u8 *TextDumper::blockEnd (const u8 *data)
 {
-   ostringstream result;
+   const u8 *first = m_data.first.get(), *last = first + m_data.second;
+
+   if (data < first || data >= last)
+      throw exception("Found a pointer outside of the file.");
 
-   for (u32 i=0; ; i++)
+   const u8 *end = (const u8 *)memchr(data, 0x00, last - data);
+   if (!end) end = last;
+
+   for (const u8 *i = data; i < end; i++)
    {
-      if (data[i] == 0x00) break;
-      else if (data[i] == 0x01) result << endl << endl << endl;
-      else if (data[i] == 0x02) result << endl;
-      else if (data[i] >= 0x03 && data[i] <= 0x0e)
+      if (isMte(*i) && i + 1 < last)
       {
-         u16 mte = (data[i++] << 8) | (data[i + 1] & 0xff);
-         string r = m_tbl.find<u16>(mte);
+         if (i + 1 == end)
+         {
+            end = (const u8 *)memchr(end + 1, 0x00, last - end - 1);
+            if (!end) end = last;
+         }
 
-         result << '[' << (r.empty() ? hexEncode<u16>(mte) : r) << ']';
+         m_usage.markMte(i[0], i[1]), i++;
       }
-      else
+      else m_usage.markByte(*i);
+   }
+
+   return end;
+}
+
+/**
+* Translates a binary block from FF8 files into a readable text script,
+* once for each table.
+* @param data A pointer into the location of the given block.
+* @param result Where the readable text will be written to, one per table.
+* @param slot Where the pointer to the block is stored (only used by records).
+* @param size Size of the pointer, in bytes.
+* @param base Position the pointer is relative to.
+*/
+void TextDumper::translateBlock (const u8 *data, const sinks_type &result, const u8 *slot, u32 size, const u8 *base)
+{
+   u32 index = m_numBlocks++;
+   const u8 *end = blockEnd(data);
+
+   string record;
+
+   if (m_recording)
+   {
+      const u8 *first = m_data.first.get(), *last = first + m_data.second;
+      u32 length = static_cast<u32>(end - data) + (end != last ? 1 : 0);
+
+      record = (boost::format("@@ slot=%08X size=%u base=%08X offset=%08X length=%u\n")
+         % (slot - first) % size % (base - first) % (data - first) % length).str();
+   }
+
+   if (m_sharing)
+   {
+      map<const u8 *, u32>::iterator found = m_shared.find(data);
+
+      if (found != m_shared.end())
       {
-         string r = m_tbl.find<u8>(data[i]);
-         result << (r.empty() ? "[" + hexEncode<u8>(data[i]) + "]" : r);
+         string marker = record + "\n" + string(33, '-') + " shared:" + boost::lexical_cast<string>(found->second) + "\n";
+
+         for (sinks_type::const_iterator i = result.begin(); i != result.end(); ++i)
+            if (*i) (*i)->write(marker.data(), static_cast<u32>(marker.size()));
+
+         return;
       }
+
+      m_shared[data] = index;
    }
 
-   result << endl << string(33, '-') << endl;
-   return result.str();
+   for (u32 t = 0; t < m_tbls.size(); t++)
+   {
+      if (!result[t]) continue;
+
+      const DictionaryView &view = m_tbls[t]->view();
+      const DictionaryView::Fragment *bytes = &m_bytes[t * 256];
+
+      // the block is put together in a buffer kept between blocks, then written at once
+      string &script = m_block;
+      script.assign(record);
+
+      for (const u8 *i = data; i < end; i++)
+      {
+         if (isMte(*i) && i + 1 < end)
+         {
+            const DictionaryView::Fragment &r = view.mte(i[0], i[1]);
+            script.append(r.text, r.length), i++;
+         }
+         else
+         {
+            const DictionaryView::Fragment &r = bytes[*i];
+            script.append(r.text, r.length);
+         }
+      }
+
+      script.append(BlockSeparator);
+      result[t]->write(script.data(), static_cast<u32>(script.size()));
+   }
 }
\ No newline at end of file
@@ -22,9 +22,13 @@
 #include "common.hpp"
 #include "dictionary.hpp"
 #include "pointerdesc.hpp"
+#include "code_usage.hpp"
+#include "script_sink.hpp"
+#include "text_format.hpp"
 
 #include <map>
 #include <string>
+#include <vector>
 #include <utility>
 #include <boost/format.hpp>
 #include <boost/shared_array.hpp>
@@ -32,44 +36,110 @@
 /**
 * Dumps text data into a readable format from all the
 * major file types found in the Final Fantasy 8 game.
+* Several tables can be used at once, producing one script
+* per table from a single walk over the pointers. Scripts are
+* written to sinks block by block, as they're decoded.
+*
+* In Battle, Packed and MenuBattle files, a block pointed to again is only
+* translated once. Later copies are left empty, with a separator saying
+* which block they share the text with ("----- shared:N", N counted from 0).
+*
+* Optionally, each block is preceded by a record telling where its pointer
+* and text were found ("@@ slot=... size=... base=... offset=... length=..."),
+* so the inserter can patch the pointers without walking the file again.
 */
-class TextDumper
+class TextDumper : public TextFormat
 {
 public:
    /** Used to represent a binary data block */
    typedef std::pair<boost::shared_array<u8>, u32> filedata_type;
 
+   /** Tables used to translate the text, one script is dumped for each */
+   typedef std::vector<const Dictionary *> tables_type;
+
+   /** Where the scripts are written to, one for each table */
+   typedef std::vector<ScriptSink *> sinks_type;
+
+   /** A text section of the file, dumped along with the others */
+   typedef struct tagFF8TextSection {
+      tagFF8TextSection (int fmt = -1, u32 ptr = 0, u32 txt = 0) :
+         type(fmt), ptrOff(ptr), txtOff(txt) { }
+
+      int type;          /**< Format of the section.                        */
+      u32 ptrOff;        /**< Offset of the pointers table.                 */
+      u32 txtOff;        /**< Offset of the text data.                      */
+      sinks_type sinks;  /**< Where its scripts are written to.             */
+      CodeUsage usage;   /**< Codes found in the text, set by the dump.     */
+      std::string error; /**< Why the dump failed (empty if it didn't).     */
+   } Section;
+
    TextDumper (const filedata_type &data, const Dictionary &dic) :
-      m_data(data), m_tbl(dic) { }
-
-   enum {
-      Battle,     /**< Field Battle files (.dat)       */
-      Field,      /**< Field Dialogs files (.msd)      */
-      Linear,     /**< Misc files with linear pointers */
-      Packed,     /**< Main Menu files                 */
-      SeedTest,   /**< SeeD Test files                 */
-      Refines,    /**< Refine System files             */
-      MenuHelp,   /**< Help System files               */
-      MenuBattle, /**< Battle Menu System files        */
-      MainMenu    /**< Main menu basic entries data    */
-   };
+      m_data(data), m_tbls(1, &dic), m_numBlocks(0), m_sharing(false), m_records(false), m_recording(false) { compile(); }
+
+   TextDumper (const filedata_type &data, const tables_type &dics) :
+      m_data(data), m_tbls(dics), m_numBlocks(0), m_sharing(false), m_records(false), m_recording(false) { compile(); }
 
    void dump(std::string &result, int type, u32 ptrOff = 0, u32 txtOff = 0);
+   void dump(std::vector<std::string> &results, int type, u32 ptrOff = 0, u32 txtOff = 0);
+   void dump(ScriptSink &sink, int type, u32 ptrOff = 0, u32 txtOff = 0);
+   void dump(const sinks_type &sinks, int type, u32 ptrOff = 0, u32 txtOff = 0);
+   void dump(std::vector<Section> &sections);
+
+   /**
+   * Gets the codes found in the text during the last dump.
+   * @return Bitmap of the codes.
+   */
+   const CodeUsage &usage () const { return m_usage; }
+
+   /**
+   * Changes whether each block is preceded by its record (off by default).
+   * SeedTest and MenuHelp files, whose blocks don't have a pointer of their
+   * own, are always dumped without them.
+   * @param enable Whether the records are written.
+   */
+   void records (bool enable) { m_records = enable; }
 
 private:
-   void dumpFromBattleScene (std::string &result);
-   void dumpFromFieldDialogs (std::string &result);
-   void dumpFromLinearData (std::string &result, u32 ptrOff, bool seedTest = false);
-   void dumpFromPackedData (std::string &result, u32 ptrOff);
-   void dumpFromRefinesData (std::string &result, u32 ptrOff, u32 txtOff);
-   void dumpFromMenuHelpData (std::string &result, u32 ptrOff, u32 txtOff);
-   void dumpFromMenuBattleData (std::string &result, u32 ptrOff, u32 txtOff);
-   void dumpFromMainMenuData (std::string &result, u32 ptrOff);
-   std::string translateBlock (const u8 *data);
+   struct SectionDump;
+
+   template <class Format> void dumpAs (const sinks_type &result, u32 ptrOff, u32 txtOff, int block);
+
+   void dumpFrom (FormatTraits<Battle>, const sinks_type &result, u32, u32, int) { dumpFromBattleScene(result); }
+   void dumpFrom (FormatTraits<Field>, const sinks_type &result, u32, u32, int) { dumpFromFieldDialogs(result); }
+   void dumpFrom (FormatTraits<Linear>, const sinks_type &result, u32 ptrOff, u32, int) { dumpFromLinearData(result, ptrOff); }
+   void dumpFrom (FormatTraits<Packed>, const sinks_type &result, u32 ptrOff, u32, int) { dumpFromPackedData(result, ptrOff); }
+   void dumpFrom (FormatTraits<SeedTest>, const sinks_type &result, u32 ptrOff, u32, int) { dumpFromLinearData(result, ptrOff, true); }
+   void dumpFrom (FormatTraits<Refines>, const sinks_type &result, u32 ptrOff, u32 txtOff, int) { dumpFromRefinesData(result, ptrOff, txtOff); }
+   void dumpFrom (FormatTraits<MenuHelp>, const sinks_type &result, u32 ptrOff, u32 txtOff, int) { dumpFromMenuHelpData(result, ptrOff, txtOff); }
+   void dumpFrom (FormatTraits<MenuBattle>, const sinks_type &result, u32 ptrOff, u32 txtOff, int block) { dumpFromMenuBattleData(result, ptrOff, txtOff, block); }
+   void dumpFrom (FormatTraits<MainMenu>, const sinks_type &result, u32 ptrOff, u32, int) { dumpFromMainMenuData(result, ptrOff); }
+
+   void dumpFromBattleScene (const sinks_type &result);
+   void dumpFromFieldDialogs (const sinks_type &result);
+   void dumpFromLinearData (const sinks_type &result, u32 ptrOff, bool seedTest = false);
+   void dumpFromPackedData (const sinks_type &result, u32 ptrOff);
+   void dumpFromRefinesData (const sinks_type &result, u32 ptrOff, u32 txtOff);
+   void dumpFromMenuHelpData (const sinks_type &result, u32 ptrOff, u32 txtOff);
+   void dumpFromMenuBattleData (const sinks_type &result, u32 ptrOff, u32 txtOff, int n);
+   void dumpFromMainMenuData (const sinks_type &result, u32 ptrOff);
+   void dumpSection (const sinks_type &result, int type, u32 ptrOff, u32 txtOff, int block);
+   void dumpRange (Section *sections, const int *blocks, u32 first, u32 last) const;
+   std::map<u32, int> menuBattleBlocks () const;
+   void compile ();
+   const u8 *blockEnd (const u8 *data);
+   void translateBlock (const u8 *data, const sinks_type &result, const u8 *slot = 0, u32 size = 0, const u8 *base = 0);
 
    const filedata_type m_data;    /**< Data containing text data to be dumped from.                 */
-   const Dictionary &m_tbl;       /**< Dictionary used to translate binary data into readable text. */
+   const tables_type m_tbls;      /**< Dictionaries used to translate binary data into readable text. */
+   std::vector<DictionaryView::Fragment> m_bytes; /**< Text of each single byte, 256 per table.    */
+   std::string m_block;                           /**< Text of the block being translated.        */
+   std::map<const u8 *, u32> m_shared;            /**< Blocks translated so far, by position.     */
+   u32 m_numBlocks;                               /**< Blocks written so far in the script.       */
+   bool m_sharing;                                /**< Whether repeated blocks are shared.        */
+   bool m_records;                                /**< Whether blocks are preceded by records.    */
+   bool m_recording;                              /**< Whether the current section gets them.     */
    PointerDescription m_ptrdesc;  /**< Description of all pointer blocks in the battle module.      */
+   CodeUsage m_usage;             /**< Codes found in the text during the last dump.                */
 };
 
 #endif //~TEXTDUMPER_HPP
\ No newline at end of file
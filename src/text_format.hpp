@@ -0,0 +1,133 @@
+/*
+ * Phantasia - Final Fantasy VIII Romhacking Tools
+ * Copyright (C) 2005 Ricardo J. Ricken (Darkl0rd)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef TEXTFORMAT_HPP
+#define TEXTFORMAT_HPP
+
+#include "common.hpp"
+#include <exception>
+
+/**
+* Formats of the text data found in the game files, shared by the dumper
+* and the inserter. What sets each format apart is described by its traits
+* (see FormatTraits), so the code handling them is written once, as
+* templates, and the format is only looked at once for each section.
+*/
+class TextFormat
+{
+public:
+   enum {
+      Battle,     /**< Field Battle files (.dat)       */
+      Field,      /**< Field Dialogs files (.msd)      */
+      Linear,     /**< Misc files with linear pointers */
+      Packed,     /**< Main Menu files                 */
+      SeedTest,   /**< SeeD Test files                 */
+      Refines,    /**< Refine System files             */
+      MenuHelp,   /**< Help System files               */
+      MenuBattle, /**< Battle Menu System files        */
+      MainMenu    /**< Main menu basic entries data    */
+   };
+
+   /**
+   * Calls a visitor with the traits of the given format.
+   * @param type The format.
+   * @param visitor Object whose operator() takes the traits of any format.
+   */
+   template <class Visitor> static void visit (int type, Visitor &visitor);
+};
+
+/**
+* Traits of a text format, one specialization for each of them:
+* - pointer_type: type of the pointers to the text blocks.
+* - NewSessions: whether the text may start new sessions (0x01).
+* - Dtes: whether the text may be encoded using DTEs.
+* - Sharing: whether several pointers may point to the same block.
+* - OwnPointers: whether every block has a pointer of its own.
+* - Alignment: boundary each piece of the text data starts at.
+* - Sector: boundary the whole text data is padded to (0 if none).
+*/
+template <int Format> struct FormatTraits;
+
+template <> struct FormatTraits<TextFormat::Battle> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::Battle, NewSessions = true, Dtes = true, Sharing = true, OwnPointers = true, Alignment = 1, Sector = 0 };
+};
+
+template <> struct FormatTraits<TextFormat::Field> {
+   typedef u32 pointer_type;
+   enum { Type = TextFormat::Field, NewSessions = true, Dtes = true, Sharing = false, OwnPointers = true, Alignment = 1, Sector = 0 };
+};
+
+template <> struct FormatTraits<TextFormat::Linear> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::Linear, NewSessions = false, Dtes = false, Sharing = false, OwnPointers = true, Alignment = 1, Sector = 0 };
+};
+
+template <> struct FormatTraits<TextFormat::Packed> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::Packed, NewSessions = false, Dtes = false, Sharing = true, OwnPointers = true, Alignment = 4, Sector = 2048 };
+};
+
+// the pointer of a seedtest block points to the answer, not to the text
+template <> struct FormatTraits<TextFormat::SeedTest> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::SeedTest, NewSessions = false, Dtes = false, Sharing = false, OwnPointers = false, Alignment = 1, Sector = 0 };
+};
+
+// TODO check if refines can use DTEs
+template <> struct FormatTraits<TextFormat::Refines> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::Refines, NewSessions = false, Dtes = false, Sharing = false, OwnPointers = true, Alignment = 1, Sector = 2048 };
+};
+
+// the body of a help page follows its title, without a pointer of its own
+template <> struct FormatTraits<TextFormat::MenuHelp> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::MenuHelp, NewSessions = false, Dtes = true, Sharing = false, OwnPointers = false, Alignment = 4, Sector = 2048 };
+};
+
+template <> struct FormatTraits<TextFormat::MenuBattle> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::MenuBattle, NewSessions = false, Dtes = false, Sharing = true, OwnPointers = true, Alignment = 4, Sector = 0 };
+};
+
+template <> struct FormatTraits<TextFormat::MainMenu> {
+   typedef u16 pointer_type;
+   enum { Type = TextFormat::MainMenu, NewSessions = false, Dtes = false, Sharing = false, OwnPointers = true, Alignment = 1, Sector = 0 };
+};
+
+template <class Visitor> void TextFormat::visit (int type, Visitor &visitor)
+{
+   switch (type)
+   {
+      case Battle:     visitor(FormatTraits<Battle>());     break;
+      case Field:      visitor(FormatTraits<Field>());      break;
+      case Linear:     visitor(FormatTraits<Linear>());     break;
+      case Packed:     visitor(FormatTraits<Packed>());     break;
+      case SeedTest:   visitor(FormatTraits<SeedTest>());   break;
+      case Refines:    visitor(FormatTraits<Refines>());    break;
+      case MenuHelp:   visitor(FormatTraits<MenuHelp>());   break;
+      case MenuBattle: visitor(FormatTraits<MenuBattle>()); break;
+      case MainMenu:   visitor(FormatTraits<MainMenu>());   break;
+
+      default:
+         throw std::exception("There's no such text format.");
+   }
+}
+
+#endif //~TEXTFORMAT_HPP
\ No newline at end of file
@@ -18,167 +18,315 @@
 
 #include "text_inserter.hpp"
 #include <exception>
+#include <cstring>
 #include <boost/bind.hpp>
-#include <boost/regex.hpp>
-#include <boost/algorithm/string_regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/format.hpp>
+#include <map>
 
 using namespace std;
 using boost::shared_array;
 
 /**
-* Manages the insert process, forwarding the data to the apropriate insert method.
-* An entire new file is created preserving the original structure.
-* @param script Text script to be inserted.
-* @param type Format of the target file.
-* @param ptrOff Offset of the pointers table (optional).
-* @param txtOff Offset of the texta data (optional).
+* Counts the zeros padding the data that ends at a given position.
+* @param first End of the data.
+* @param last Where the padding must end, at most.
+* @return Number of zeros found.
 */
-void TextInserter::insert (const string &script, int type, u32 ptrOff, u32 txtOff)
+static u32 paddingAfter (const u8 *first, const u8 *last)
 {
-   boost::regex re("\\[([\\d\\l\\u\\s_?]+)\\]");
-   boost::match_results<string::const_iterator> what;
+   const u8 *i = first;
+   while (i < last && !*i) i++;
 
-   // replaces any code inside brackets with an hexstring representation
-   string temp = script;
-   while (boost::regex_search(temp.cbegin(), temp.cend(), what, re))
+   return static_cast<u32>(i - first);
+}
+
+/**
+* Reads a named number from a record, such as " size=4".
+* @param pos Where the field starts, moved past it.
+* @param last End of the record.
+* @param name Text that comes before the number.
+* @param hex Whether the number is written in uppercase hexadecimal.
+* @param digits Most digits the number can have.
+* @param value Where the number is stored.
+* @return Whether the field was found.
+*/
+static bool readField (const char *&pos, const char *last, const char *name, bool hex, u32 digits, u32 &value)
+{
+   const u32 nameLen = static_cast<u32>(strlen(name));
+   if (static_cast<u32>(last - pos) < nameLen || !equal(name, name + nameLen, pos)) return false;
+
+   const char *first = pos + nameLen, *i = first;
+   value = 0;
+
+   for (; i < last; i++)
    {
-      string code = what[1];
-      if (m_tbl.exists<u16>(code))
-      {
-         u16 value = m_tbl.find<u16>(code);
-         string enc = hexEncode<u16>(value);
-         temp.replace(what[1].first, what[1].second, enc);
-      }
-      else if (m_tbl.exists<u8>(code))
-      {
-         string enc = hexEncode<u8>(m_tbl.find<u8>(code));
-         temp.replace(what[1].first, what[1].second, enc);
-      }
-      else throw exception(("Invalid code found: " + code).c_str());
+      u32 digit;
+      if (*i >= '0' && *i <= '9') digit = *i - '0';
+      else if (hex && *i >= 'A' && *i <= 'F') digit = *i - 'A' + 10;
+      else break;
+
+      if (static_cast<u32>(i - first) == digits) return false;
+      value = value * (hex ? 16 : 10) + digit;
    }
 
-   // splits the script into sections delimited by the endstrings
-   vector<string> lines;
-   boost::split_regex(lines, temp, boost::regex("\\n-{33}\\n")).pop_back();
-      
-   switch (type)
+   pos = i;
+   return i > first;
+}
+
+/** Orders encoded blocks by their bytes read backwards. */
+struct ReversedLess
+{
+   ReversedLess (const vector<pair<const u8 *, u32> > &b) : blocks(b) { }
+
+   bool operator() (u32 a, u32 b) const {
+      const u8 *first1 = blocks[a].first, *last1 = first1 + blocks[a].second;
+      const u8 *first2 = blocks[b].first, *last2 = first2 + blocks[b].second;
+
+      return lexicographical_compare(reverse_iterator<const u8 *>(last1), reverse_iterator<const u8 *>(first1),
+         reverse_iterator<const u8 *>(last2), reverse_iterator<const u8 *>(first2));
+   }
+
+   const vector<pair<const u8 *, u32> > &blocks;
+};
+
+/** Forwards a script to the insert method of its format. */
+struct TextInserter::ScriptInsertion
+{
+   ScriptInsertion (TextInserter &i, const string &s, u32 p, u32 t, bool r) :
+      inserter(i), script(s), ptrOff(p), txtOff(t), records(r) { }
+
+   template <class Format> void operator() (Format) {
+      inserter.insertAs<Format>(script, ptrOff, txtOff, records);
+   }
+
+   TextInserter &inserter;
+   const string &script;
+   u32 ptrOff, txtOff;
+   bool records;
+};
+
+/**
+* Encodes a script whose format is known at compile time, then inserts it.
+* @param script Text script to be inserted.
+* @param ptrOff Offset of the pointers table.
+* @param txtOff Offset of the text data.
+* @param records Whether the blocks start with their records.
+*/
+template <class Format> void TextInserter::insertAs (const string &script, u32 ptrOff, u32 txtOff, bool records)
+{
+   typedef typename Format::pointer_type pointer_type;
+
+   if (records)
    {
-      case Battle: {
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+      insertIntoRecords(script, Format::NewSessions, Format::Dtes);
+      return;
+   }
 
-         // encodes the entire script
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets);
+   // the text is never encoded into more bytes than it takes in the script
+   shared_array<u8> buffer(new u8[script.size() + 1]);
+   vector<u32> block_offsets;
 
-         // field battle pointers are 16-bit wide
-         vector<u16> pointers(block_offsets.size());
-         transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, u16>());
+   u32 bufferLen = encodeScript(script, buffer.get(), block_offsets, Format::NewSessions, Format::Dtes);
 
-         insertIntoBattleScene(make_pair(buffer, bufferLen), pointers);
-      }
-      break;
+   vector<pointer_type> pointers(block_offsets.size());
+   transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, pointer_type>());
 
-      case Field: {
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+   insertInto(Format(), make_pair(buffer, bufferLen), pointers, ptrOff, txtOff);
+}
 
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets);
-         insertIntoFieldDialogs(make_pair(buffer, bufferLen), block_offsets);
-      }
-      break;
+/**
+* Help pages are made of a title and a body, encoded into a single
+* piece of text data with its own flags.
+*/
+template <> void TextInserter::insertAs<FormatTraits<TextFormat::MenuHelp> > (const string &script, u32 ptrOff, u32 txtOff, bool records)
+{
+   typedef FormatTraits<MenuHelp> Format;
 
-      /* case SeedTest:  { 
-         vector<u16> pointers(block_offsets.size());
-         copy(block_offsets.begin(), block_offsets.end(), pointers.begin());
+   if (records) throw exception("Records can't be used for blocks without a pointer of their own.");
 
-         ignoreNewsessions = false;
+   // TODO check if DTEs can REALLY be used
+   shared_array<u8> buffer(new u8[script.size() + 1]);
+   vector<u32> offsets;
 
-         return insertIntoSeedTest(make_pair(buffer, bufferPos), pointers, make_pair(fileData, fileLen)); 
-      }
-      break; */
+   u32 bufferLen = encodeScript(script, buffer.get(), offsets, Format::NewSessions, Format::Dtes);
+   if (offsets.size() % 2) throw exception("Every help page needs both a title and a body.");
+
+   vector<filedata_type> blocks;
 
-      case Packed: {
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+   for (u32 i = 0; i < offsets.size(); i += 2)
+   {
+      u32 first = offsets[i], last = i + 2 < offsets.size() ? offsets[i + 2] : bufferLen;
 
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets, false, false);
+      shared_array<u8> page(new u8[last - first]);
+      copy(buffer.get() + first, buffer.get() + last, page.get());
+
+      blocks.push_back(make_pair(page, last - first));
+   }
 
-         vector<u16> pointers(block_offsets.size());
-         transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, u16>());
+   insertIntoMenuHelpData(blocks, ptrOff, txtOff);
+}
+
+/**
+* Manages the insert process, forwarding the data to the apropriate insert method.
+* An entire new file is created preserving the original structure.
+* @param script Text script to be inserted.
+* @param type Format of the target file.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the texta data (optional).
+*/
+void TextInserter::insert (const string &script, int type, u32 ptrOff, u32 txtOff)
+{
+   insertSection(script, type, ptrOff, txtOff);
+   assemble();
+}
 
-         insertIntoPackedData(make_pair(buffer, bufferLen), pointers, ptrOff);
+/**
+* Inserts several sections of the file at once. Their offsets are the ones
+* found in the original file, whatever the order they're inserted in: the
+* text whose length changed is only spliced into the file after all of
+* them, in a single pass. An error in one section doesn't stop the others.
+* @param sections The sections, whose errors are filled.
+*/
+void TextInserter::insert (vector<Section> &sections)
+{
+   for (vector<Section>::iterator i = sections.begin(); i != sections.end(); ++i)
+   {
+      try {
+         insertSection(i->script, i->type, i->ptrOff, i->txtOff);
+      }
+      catch (const exception &e) {
+         i->error = e.what();
       }
-      break;
+   }
 
-      case Refines: {
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+   assemble();
+}
 
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets, false, /* TODO check if refines can use DTEs */false);
+/**
+* Measures the room a script would take when inserted, without changing the
+* file. The same steps of the insertion are taken, up to where the text
+* would be written.
+* @param script Text script to be measured.
+* @param type Format of the section.
+* @param ptrOff Offset of the pointers table (optional).
+* @param txtOff Offset of the text data (optional).
+* @return Sizes of the original and the new text.
+*/
+TextInserter::Capacity TextInserter::measure (const string &script, int type, u32 ptrOff, u32 txtOff)
+{
+   Capacity result;
+   m_capacity = &result;
 
-         vector<u16> pointers(block_offsets.size());
-         transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, u16>());
+   try {
+      insertSection(script, type, ptrOff, txtOff);
+   }
+   catch (...) {
+      m_capacity = 0;
+      throw;
+   }
 
-         insertIntoRefinesData(make_pair(buffer, bufferLen), pointers, ptrOff, txtOff);
-      }
-      break;
+   m_capacity = 0;
+   return result;
+}
 
-      case MenuHelp: {
-         vector<filedata_type> blocks;
+/**
+* Stores the sizes of a section during a dry run.
+* @param original Bytes taken by the original text.
+* @param slack Bytes of padding after the original text.
+* @param encoded Bytes taken by the new text.
+* @param limited Whether the new text must fit in the original room.
+* @return True if it's a dry run, when the insertion must stop right away.
+*/
+bool TextInserter::measured (u32 original, u32 slack, u32 encoded, bool limited)
+{
+   if (!m_capacity) return false;
 
-         for (vector<string>::iterator i = lines.begin(); i != lines.end(); i += 2)
-         {
-            shared_array<u8> buffer(new u8[i->size() + (i + 1)->size() + 32]);
-            
-            u32 bufferLen = translateBlock(*i, buffer.get(), false, /* TODO check if DTEs can REALLY be used */true);
-            buffer.get()[bufferLen++] = 0x00;
+   m_capacity->original = original;
+   m_capacity->slack = slack;
+   m_capacity->encoded = encoded;
+   m_capacity->limited = limited;
 
-            bufferLen += translateBlock(*(i + 1), buffer.get() + bufferLen, false, /* TODO check if DTEs can REALLY be used */true);
-            buffer.get()[bufferLen++] = 0x00;
+   return true;
+}
 
-            blocks.push_back(make_pair(buffer, bufferLen));
-         }
+/**
+* Inserts a section without splicing the text whose length changed.
+* @param script Text script to be inserted.
+* @param type Format of the section.
+* @param ptrOff Offset of the pointers table.
+* @param txtOff Offset of the text data.
+*/
+void TextInserter::insertSection (const string &script, int type, u32 ptrOff, u32 txtOff)
+{
+   // scripts dumped along with records tell where each pointer is, whatever the type of file
+   bool records = script.compare(0, 3, "@@ ") == 0;
 
-         insertIntoMenuHelpData(blocks, ptrOff, txtOff);
-      }
-      break;
+   ScriptInsertion insertion(*this, script, ptrOff, txtOff, records);
+   TextFormat::visit(type, insertion);
+}
 
-      case MenuBattle: {
-         if (!m_ptrdesc.isLoaded()) m_ptrdesc.loadFromFile("battle-module.xml");
+/**
+* Splices the text whose length changed into the file, copying it only once,
+* then moves the offsets held by the header. Header fields holding the same
+* offset as the spliced text are only moved if they follow its own field,
+* as their (empty) sections come after it.
+*/
+void TextInserter::assemble ()
+{
+   if (m_splices.empty()) return;
 
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+   sort(m_splices.begin(), m_splices.end());
 
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets, false, false);
+   u8 *originalPtr = m_data.first.get();
+   u32 originalLen = m_data.second, newLen = originalLen;
 
-         vector<u16> pointers(block_offsets.size());
-         transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, u16>());
+   for (vector<Splice>::iterator i = m_splices.begin(); i != m_splices.end(); ++i)
+   {
+      if (i != m_splices.begin() && i->offset < (i - 1)->offset + (i - 1)->length)
+         throw exception("Two sections of the file overlap.");
 
-         insertIntoMenuBattleData(make_pair(buffer, bufferLen), pointers, ptrOff, txtOff);
-      }
-      break;
+      newLen += i->data.second - i->length;
+   }
+
+   shared_array<u8> buffer(new u8[newLen]);
+   u8 *bufferPtr = buffer.get();
+   u32 originalPos = 0;
 
-      case MainMenu: {
-         shared_array<u8> buffer(new u8[script.size()]);
-         vector<u32> block_offsets;
+   for (vector<Splice>::iterator i = m_splices.begin(); i != m_splices.end(); ++i)
+   {
+      bufferPtr = copy(originalPtr + originalPos, originalPtr + i->offset, bufferPtr);
+      bufferPtr = copy(i->data.first.get(), i->data.first.get() + i->data.second, bufferPtr);
+      originalPos = i->offset + i->length;
+   }
 
-         u32 bufferLen = encodeScript(lines, buffer.get(), block_offsets, false, false);
+   copy(originalPtr + originalPos, originalPtr + originalLen, bufferPtr);
 
-         vector<u16> pointers(block_offsets.size());
-         transform(block_offsets.begin(), block_offsets.end(), pointers.begin(), s_cast<u32, u16>());
+   for (set<u32>::iterator f = m_offsetFields.begin(); f != m_offsetFields.end(); ++f)
+   {
+      u32 value = *((u32 *)(originalPtr + *f)), newValue = value, field = *f;
+
+      for (vector<Splice>::iterator i = m_splices.begin(); i != m_splices.end(); ++i)
+      {
+         int delta = i->data.second - i->length;
 
-         insertIntoMainMenuData(make_pair(buffer, bufferLen), pointers, ptrOff);
+         if (value > i->offset || (value == i->offset && *f > i->field)) newValue += delta;
+         if (*f >= i->offset + i->length) field += delta;
       }
-      break;
 
-      default:
-         throw exception("TextInserter is unable to insert into the specified file type.");
+      *((u32 *)(buffer.get() + field)) = newValue;
    }
+
+   m_data = make_pair(buffer, newLen);
+   m_splices.clear();
+   m_offsetFields.clear();
 }
 
 /**
 * Inserts a binary block of encoded text data into FFVIII Field Battle files (.dat).
-* The file gets reconstructed and the original data is preserved.
+* The new text is written over the old one if it fits there (along with the
+* padding after it). Otherwise the file gets reconstructed and the original
+* data is preserved.
 * @param scriptData Encoded text data to be inserted.
 * @param pointers Pointers to each text block inside the encoded text data.
 */
@@ -208,6 +356,20 @@ void TextInserter::insertIntoBattleScene (const filedata_type &scriptData, vecto
    u32 extraLen = lastBlockEnd - textDataPtr - *last_ptr + 1;
 
    u32 oldDataLen = *last_ptr + extraLen - *first_ptr;
+   u32 room = oldDataLen + paddingAfter(textDataPtr + oldDataLen, originalPtr + header.ptr_soundsec1);
+   if (measured(oldDataLen, room - oldDataLen, newDataLen, false)) return;
+
+   // ------------------------------------------
+   // write over the old data, leaving the rest of the file as it is
+   if (pointers.size() == static_cast<u32>(last_ptr - first_ptr + 1) && newDataLen <= room)
+   {
+      copy(pointers.begin(), pointers.end(), first_ptr);
+
+      u8 *textEnd = copy(newDataPtr, newDataPtr + newDataLen, textDataPtr);
+      if (newDataLen < oldDataLen) fill(textEnd, textDataPtr + oldDataLen, 0x00);
+
+      return;
+   }
 
    // ------------------------------------------
    // rebuild the entire file using the new data
@@ -266,6 +428,25 @@ void TextInserter::insertIntoFieldDialogs (const filedata_type &scriptData, vect
 
    u32 oldDataLen = *last_ptr + extraLen - *first_ptr;
 
+   u8 *textDataPtr = originalPtr + header.ptr_textdata + *first_ptr;
+   u32 room = oldDataLen + paddingAfter(textDataPtr + oldDataLen, originalPtr + header.ptr_section9);
+   if (measured(oldDataLen, room - oldDataLen, newDataLen, false)) return;
+
+   // the pointers are relative to the start of the pointers table
+   transform(pointers.begin(), pointers.end(), pointers.begin(), bind2nd(plus<u32>(), pointers.size() * 4));
+
+   // ------------------------------------------
+   // write over the old data, leaving the rest of the file as it is
+   if (pointers.size() * 4 == *first_ptr && newDataLen <= room)
+   {
+      copy(pointers.begin(), pointers.end(), first_ptr);
+
+      u8 *textEnd = copy(newDataPtr, newDataPtr + newDataLen, textDataPtr);
+      if (newDataLen < oldDataLen) fill(textEnd, textDataPtr + oldDataLen, 0x00);
+
+      return;
+   }
+
    // ------------------------------------------
    // rebuild the entire file using the new data
    shared_array<u8> buffer(new u8[originalLen + newDataLen - oldDataLen]);
@@ -277,7 +458,6 @@ void TextInserter::insertIntoFieldDialogs (const filedata_type &scriptData, vect
    bufferTail += header.ptr_textdata;
 
    // update the pointers table
-   transform(pointers.begin(), pointers.end(), pointers.begin(), bind2nd(plus<u32>(), pointers.size() * 4));
    copy(pointers.begin(), pointers.end(), (u32 *)(bufferPtr + bufferTail));
    bufferTail += pointers.size() * 4;
 
@@ -331,8 +511,20 @@ void TextInserter::insertIntoLinearData (const filedata_type &scriptData, vector
    make_pair(buffer, bufferTail);
 }
 
+/**
+* Inserts text into packed menu data, made of up to 17 sub-blocks (each one a
+* pointers table followed by its text), which must fit in the sectors taken
+* by the original data. Every sub-block starts at an aligned offset and so
+* does the end of the sectors, so the room wasted on alignment is the same
+* whatever the order of the sub-blocks, which is kept. When the data doesn't
+* fit, the error tells how much text each sub-block would have to lose.
+* @param scriptData Encoded text data to be inserted.
+* @param pointers Pointers to each text block inside the encoded text data.
+* @param ptrOff Offset of the packed data.
+*/
 void TextInserter::insertIntoPackedData (const filedata_type &scriptData, vector<u16> &pointers, u32 ptrOff)
 {
+   typedef FormatTraits<Packed> Format;
    u8 *originalPtr = m_data.first.get(), *newDataPtr = scriptData.first.get();
    u32 originalLen = m_data.second, newDataLen = scriptData.second;
 
@@ -346,70 +538,116 @@ void TextInserter::insertIntoPackedData (const filedata_type &scriptData, vector
    u32 oldDataLen = distance(dataPtr, lastPtrEnd);
 
    // each packed block is aligned in a 2048-byte block, therefore there's padding in each one
-   int oldDataPadding = calcPadding(oldDataLen, 2048);
+   int oldDataPadding = calcPadding(oldDataLen, Format::Sector);
    // we are limited to this length, so the new data must fit inside
    u32 maxDataLength = oldDataLen + oldDataPadding;
 
    // ------------------------------------------
-   // rebuild the entire packed block using the modified data
-   shared_array<u8> buffer(new u8[maxDataLength + 2048]);
-   u8 *bufferPtr = buffer.get();
-   u32 bufferTail = 0;
-
-   copy(dataPtr, dataPtr + sizeof(PackedMenuHeader), bufferPtr);
-   bufferTail += sizeof(PackedMenuHeader);
-
-   headerPtr = (PackedMenuHeader *)bufferPtr;
+   // rebuild each sub-block on its own, so their sizes are known before anything is written
+   vector<vector<u8> > subBlocks;
+   vector<u16 *> slots;
+   vector<u32> lengths, oldLengths, textLengths;
    vector<u16>::iterator blockPtrs = pointers.begin();
-   
+   u32 bufferLen = sizeof(PackedMenuHeader);
+
    // iterates through every block ptr in the header
    for (u16 *curBlock = headerPtr->blocks; curBlock != headerPtr->blocks + 17; curBlock++)
    {
       if (*curBlock == 0x0000) continue;
       u16 num_ptr = *(dataPtr + *curBlock);
-      u16 newBlockOff = static_cast<u16>(bufferTail);
+      u32 tableLen = num_ptr * 2 + 2;
 
       // pointers to the current block ptr table
       u16 *beginPtr = (u16 *)(dataPtr + *curBlock);
       u16 *endPtr = (u16 *)(dataPtr + *curBlock) + num_ptr + 1;
 
-      copy(beginPtr, endPtr, (u16 *)(bufferPtr + bufferTail));
-      bufferTail += num_ptr * 2 + 2;
+      // the original sub-block ends along with the last of its texts
+      u8 *oldEnd = (u8 *)endPtr;
+      for (u16 *cur = beginPtr + 1; cur != endPtr; cur++)
+         if (*cur) oldEnd = max(oldEnd, find(dataPtr + *curBlock + *cur, originalPtr + originalLen, 0x00) + 1);
 
       // find out the number of valid pointers
       u16 numValidPtrs = count_if(beginPtr + 1, endPtr, bind2nd(not_equal_to<u16>(), 0x0000));
       u8 *txtBlockBegin = newDataPtr + *blockPtrs;
       u8 *txtBlockEnd = newDataPtr + (blockPtrs + numValidPtrs >= pointers.end() ? newDataLen : *(blockPtrs + numValidPtrs));
+      u32 txtBlockLen = distance(txtBlockBegin, txtBlockEnd);
+
+      vector<u8> block(tableLen + txtBlockLen);
+      copy(beginPtr, endPtr, (u16 *)&block[0]);
+
+      // copy the modified text data of this block into place, the pointers becoming relative to it
+      if (m_compaction)
+         txtBlockLen = compactBlocks(newDataPtr, static_cast<u32>(txtBlockEnd - newDataPtr), blockPtrs, blockPtrs + numValidPtrs, &block[0] + tableLen);
+      else
+      {
+         copy(txtBlockBegin, txtBlockEnd, &block[0] + tableLen);
+         transform(blockPtrs, blockPtrs + numValidPtrs, blockPtrs, bind2nd(minus<u16>(), *blockPtrs));
+      }
 
       // correct the pointers of this block
-      transform(blockPtrs, blockPtrs + numValidPtrs, blockPtrs, bind2nd(plus<u16>(), num_ptr * 2 + 2 - *blockPtrs));
-      // correct the pointer to this block in the header
-      *curBlock = newBlockOff;
+      transform(blockPtrs, blockPtrs + numValidPtrs, blockPtrs, bind2nd(plus<u16>(), tableLen));
 
       // update the pointers table, ignoring all the annoying invalid entries
       for (int p = 0, validCount = 0; p < num_ptr; p++)
       {
-         u16 *cur = (u16 *)(bufferPtr + *curBlock) + 1 + p;
+         u16 *cur = (u16 *)&block[0] + 1 + p;
          if (*cur) *cur = *(blockPtrs + validCount++);
       }
 
-      // copy the modified text data of this block into place
-      copy(txtBlockBegin, txtBlockEnd, bufferPtr + bufferTail);
-      bufferTail += distance(txtBlockBegin, txtBlockEnd);
-
       // next block should start in a 4-byte boundary alignment
-      int padding = calcPadding(bufferTail, 4);
-      fill(bufferPtr + bufferTail, bufferPtr + bufferTail + padding, 0x00);
-      bufferTail += padding;
-      
+      block.resize(tableLen + txtBlockLen + calcPadding(tableLen + txtBlockLen, Format::Alignment), 0x00);
+      bufferLen += static_cast<u32>(block.size());
+
+      subBlocks.push_back(block);
+      slots.push_back(curBlock);
+      lengths.push_back(tableLen + txtBlockLen);
+      oldLengths.push_back(static_cast<u32>(oldEnd - (dataPtr + *curBlock)));
+      textLengths.push_back(txtBlockLen);
+
       blockPtrs += numValidPtrs;
    }
 
-   if (bufferTail > maxDataLength)
-      throw exception("Modified data exceeds maximum block length.");
+   if (measured(oldDataLen, maxDataLength - oldDataLen, bufferLen, true)) return;
+
+   if (bufferLen > maxDataLength)
+   {
+      u32 excess = bufferLen - maxDataLength;
+
+      // a sub-block loses its padding first, so shortening it costs less text
+      string plan = (boost::format("Modified data exceeds maximum block length by %1% bytes. "
+         "Sub-blocks (bytes now/before, text to cut if only that one is shortened):") % excess).str();
+
+      for (u32 i = 0; i < subBlocks.size(); i++)
+      {
+         u32 cut = excess - (static_cast<u32>(subBlocks[i].size()) - lengths[i]);
+
+         plan += (boost::format("\n  %1%: %2%/%3%, ") % (slots[i] - headerPtr->blocks) % lengths[i] % oldLengths[i]).str();
+         plan += cut <= textLengths[i] ? boost::lexical_cast<string>(cut) : "not enough text";
+      }
+
+      throw exception(plan.c_str());
+   }
+
+   // ------------------------------------------
+   // lay the sub-blocks out in their original order
+   shared_array<u8> buffer(new u8[maxDataLength]);
+   u8 *bufferPtr = buffer.get();
+   u32 bufferTail = 0;
+
+   copy(dataPtr, dataPtr + sizeof(PackedMenuHeader), bufferPtr);
+   bufferTail += sizeof(PackedMenuHeader);
+
+   for (u32 i = 0; i < subBlocks.size(); i++)
+   {
+      // correct the pointer to this block in the header
+      ((PackedMenuHeader *)bufferPtr)->blocks[slots[i] - headerPtr->blocks] = static_cast<u16>(bufferTail);
+
+      copy(subBlocks[i].begin(), subBlocks[i].end(), bufferPtr + bufferTail);
+      bufferTail += static_cast<u32>(subBlocks[i].size());
+   }
 
    // calculates the padding necessary to fill the 2048-byte block
-   int newDataPadding = calcPadding(bufferTail, 2048);
+   int newDataPadding = calcPadding(bufferTail, Format::Sector);
 
    // copy the entire rebuild data into its original place
    copy(bufferPtr, bufferPtr + bufferTail, dataPtr);
@@ -425,6 +663,7 @@ void TextInserter::insertIntoPackedData (const filedata_type &scriptData, vector
 */
 void TextInserter::insertIntoRefinesData (const filedata_type &scriptData, vector<u16> &pointers, u32 ptrOff, u32 txtOff)
 {
+   typedef FormatTraits<Refines> Format;
    u8 *originalPtr = m_data.first.get(), *newDataPtr = scriptData.first.get();
    u32 originalLen = m_data.second, newDataLen = scriptData.second;
 
@@ -443,9 +682,20 @@ void TextInserter::insertIntoRefinesData (const filedata_type &scriptData, vecto
    u32 oldDataLen = distance(textPtr, textBlockEnd);
 
    // each text block is aligned in a 2048-byte block
-   int oldDataPadding = calcPadding(oldDataLen, 2048);
+   int oldDataPadding = calcPadding(oldDataLen, Format::Sector);
    u32 maxDataLength = oldDataLen + oldDataPadding;
 
+   shared_array<u8> compacted;
+
+   if (m_compaction)
+   {
+      compacted.reset(new u8[newDataLen]);
+      newDataLen = compactBlocks(newDataPtr, newDataLen, pointers.begin(), pointers.end(), compacted.get());
+      newDataPtr = compacted.get();
+   }
+
+   if (measured(oldDataLen, oldDataPadding, newDataLen, true)) return;
+
    if (newDataLen > maxDataLength)
       throw exception("Modified data exceeds maximum block length.");
 
@@ -457,12 +707,13 @@ void TextInserter::insertIntoRefinesData (const filedata_type &scriptData, vecto
    copy(newDataPtr, newDataPtr + newDataLen, textPtr);
 
    // fill the padding area with 0x00
-   int newDataPadding = calcPadding(newDataLen, 2048);
+   int newDataPadding = calcPadding(newDataLen, Format::Sector);
    fill(textPtr + newDataLen, textPtr + newDataLen + newDataPadding, 0x00);
 }
 
 void TextInserter::insertIntoMenuHelpData (vector<filedata_type> &encBlocks, u32 ptrOff, u32 txtOff)
 {
+   typedef FormatTraits<MenuHelp> Format;
    typedef MenuHelpPointer HelpPtr;
    u8 *originalPtr = m_data.first.get();
    u32 originalLen = m_data.second;
@@ -481,12 +732,17 @@ void TextInserter::insertIntoMenuHelpData (vector<filedata_type> &encBlocks, u32
    u32 oldDataLen = distance(textPtr, textBlockEnd);
 
    // each text block is aligned in a 2048-byte block
-   int oldDataPadding = calcPadding(oldDataLen, 2048);
+   int oldDataPadding = calcPadding(oldDataLen, Format::Sector);
    u32 maxDataLength = oldDataLen + oldDataPadding;
 
+   // room for the pages, even if they don't fit (each one may take its flags and padding)
+   u32 bufferSize = maxDataLength;
+   for (vector<filedata_type>::iterator i = encBlocks.begin(); i != encBlocks.end(); ++i)
+      bufferSize += i->second + sizeof(MenuHelpTextFlags) + Format::Alignment;
+
    // ------------------------------------------
    // rebuild the entire text data block using modified data
-   shared_array<u8> buffer(new u8[maxDataLength + 2048]);
+   shared_array<u8> buffer(new u8[bufferSize]);
    u8 *bufferPtr = buffer.get();
    u32 bufferTail = 0;
 
@@ -509,16 +765,18 @@ void TextInserter::insertIntoMenuHelpData (vector<filedata_type> &encBlocks, u32
       bufferTail += i->second;
 
       // add 4-byte boundary padding
-      int padding = calcPadding(bufferTail, 4);
+      int padding = calcPadding(bufferTail, Format::Alignment);
       fill(bufferPtr + bufferTail, bufferPtr + bufferTail + padding, 0x00);
       bufferTail += padding;
    }
 
+   if (measured(oldDataLen, oldDataPadding, bufferTail, true)) return;
+
    if (bufferTail > maxDataLength)
       throw exception("Modified data exceeds maximum block length.");
 
    // add padding to align it to 2048-byte boundary
-   int newDataPadding = calcPadding(bufferTail, 2048);
+   int newDataPadding = calcPadding(bufferTail, Format::Sector);
    fill(bufferPtr + bufferTail, bufferPtr + bufferTail + newDataPadding, 0x00);
    bufferTail += newDataPadding;
 
@@ -529,6 +787,9 @@ void TextInserter::insertIntoMenuHelpData (vector<filedata_type> &encBlocks, u32
 
 void TextInserter::insertIntoMenuBattleData (const filedata_type &scriptData, vector<u16> &pointers, u32 ptrOff, u32 txtOff)
 {
+   typedef FormatTraits<MenuBattle> Format;
+   if (!m_ptrdesc.isLoaded()) m_ptrdesc.loadFromFile("battle-module.xml");
+
    u8 *originalPtr = m_data.first.get(), *newDataPtr = scriptData.first.get();
    u32 originalLen = m_data.second, newDataLen = scriptData.second;
 
@@ -539,6 +800,7 @@ void TextInserter::insertIntoMenuBattleData (const filedata_type &scriptData, ve
    // find out where the text offset of this block is located inside the pointers table
    u32 *txttbl = (u32 *)(originalPtr + 0x80);
    u32 *curtbl = find(txttbl, txttbl + 25, txtOff);
+   if (curtbl == txttbl + 25) throw exception("The text data isn't listed in the battle module.");
 
    // figure out which pointer description should be used
    int n = static_cast<int> (distance(txttbl, curtbl) + 1);
@@ -552,50 +814,45 @@ void TextInserter::insertIntoMenuBattleData (const filedata_type &scriptData, ve
       originalLen - headerPtrs[n - 1];
 
    // since each block is 4-byte aligned, we must pad with 0x00
-   int padding = calcPadding(newDataLen, 4);
-      
-   // ------------------------------------------
-   // rebuild the entire file using the new data
-   shared_array<u8> buffer(new u8[originalLen + newDataLen + padding - oldDataLen]);
-   u8 *bufferPtr = buffer.get();
-   u32 bufferTail = 0;
-
-   copy(originalPtr, textPtr, bufferPtr);
-   bufferTail += textPtr - originalPtr;
+   int padding = calcPadding(newDataLen, Format::Alignment);
+   if (measured(oldDataLen, 0, newDataLen + padding, false)) return;
 
-   // update the pointers table
+   // update the pointers table (it lies before the text, so it's copied along with it)
    for (int i = 0, curNewPtr = 0; i < m_ptrdesc[n].m_count; i++)
    {
-      u16 *cur = (u16 *)(bufferPtr + ptrOff + i * m_ptrdesc[n].m_width);
+      u16 *cur = (u16 *)(pointersPtr + i * m_ptrdesc[n].m_width);
 
       // TODO check if there's a case when group=2 and the second pointer is valid, although the first one ain't
       for (int p = 0; p < m_ptrdesc[n].m_group && *(cur + p) != 0xffff; p++)
          *(cur + p) = pointers[curNewPtr++];
    }
 
-   // copy the new data into place
-   copy(newDataPtr, newDataPtr + newDataLen, bufferPtr + bufferTail);
-   bufferTail += newDataLen;
+   // ------------------------------------------
+   // write over the old data, the block keeping its length
+   if (newDataLen <= oldDataLen)
+   {
+      u8 *textEnd = copy(newDataPtr, newDataPtr + newDataLen, textPtr);
+      fill(textEnd, textPtr + oldDataLen, 0x00);
 
-   // add padding
-   fill(bufferPtr + bufferTail, bufferPtr + bufferTail + padding, 0x00);
-   bufferTail += padding;
+      return;
+   }
 
-   // copy the remaining data back into place
-   u8 *endPtr = copy(textPtr + oldDataLen, originalPtr + originalLen, bufferPtr + bufferTail);
-   bufferTail = endPtr - bufferPtr;
+   // ------------------------------------------
+   // splice the new data (and its padding) into the file, along with any other sections
+   Splice splice;
+   splice.offset = txtOff;
+   splice.length = oldDataLen;
+   splice.field = 0x80 + (n - 1) * 4;
+   splice.data = make_pair(shared_array<u8>(new u8[newDataLen + padding]), newDataLen + padding);
 
-   if (newDataLen + padding != oldDataLen)
-   {
-      // update header pointers
-      int delta = newDataLen + padding - oldDataLen;
-      transform(headerPtrs + n, headerPtrs + 25, headerPtrs + n, bind2nd(plus<u32>(), delta));
+   u8 *paddingPtr = copy(newDataPtr, newDataPtr + newDataLen, splice.data.first.get());
+   fill(paddingPtr, paddingPtr + padding, 0x00);
 
-      // copy the updated header into place
-      copy(headerPtrs, headerPtrs + 25, (u32 *)(bufferPtr + 0x80));
-   }
+   m_splices.push_back(splice);
 
-   m_data = make_pair(buffer, bufferTail);
+   // the offsets of the text data after this block are moved
+   for (u32 i = 0; i < 25; i++)
+      m_offsetFields.insert(0x80 + i * 4);
 }
 
 void TextInserter::insertIntoMainMenuData (const filedata_type &scriptData, vector<u16> &pointers, u32 ptrOff)
@@ -614,8 +871,23 @@ void TextInserter::insertIntoMainMenuData (const filedata_type &scriptData, vect
    // this was defined manually, by looking at the available space
    const u32 maxTxtDataLength = 1686;
 
+   shared_array<u8> compacted;
+
+   if (m_compaction)
+   {
+      compacted.reset(new u8[newDataLen]);
+      newDataLen = compactBlocks(newDataPtr, newDataLen, pointers.begin(), pointers.end(), compacted.get());
+      newDataPtr = compacted.get();
+   }
+
+   // the original text ends along with the last block
+   u8 *lastBlockPtr = textPtr + *max_element(ptrBegin, ptrEnd);
+   u32 oldDataLen = min<u32>(static_cast<u32>(find(lastBlockPtr, originalPtr + originalLen, 0x00) + 1 - textPtr), maxTxtDataLength);
+
+   if (measured(oldDataLen, maxTxtDataLength - oldDataLen, newDataLen, true)) return;
+
    if (newDataLen > maxTxtDataLength)
-      throw("Modified data exceeds the maximum length");
+      throw exception("Modified data exceeds the maximum length");
    
    // update the pointers table, ignoring all the annoying invalid entries
    vector<u16>::iterator nextPtr = pointers.begin();
@@ -627,16 +899,195 @@ void TextInserter::insertIntoMainMenuData (const filedata_type &scriptData, vect
    fill(textPtr + newDataLen, textPtr + maxTxtDataLength, 0x00);
 }
 
-u32 TextInserter::encodeScript (vector<string> &lines, u8 *buffer, vector<u32> &pointers, bool newsessions, bool dtes)
+/**
+* Reads a record written by the dumper, such as
+* "@@ slot=00000010 size=2 base=00000400 offset=00000512 length=27".
+* @param record The line holding the record.
+* @param r Where the record is stored.
+* @return Whether the record is valid.
+*/
+bool TextInserter::parseRecord (const string &record, BlockRecord &r)
+{
+   const char *pos = record.data(), *last = pos + record.size();
+
+   // longer numbers than the dumper writes can't fit into 32 bits anyway
+   return readField(pos, last, "@@ slot=", true, 8, r.slot) && readField(pos, last, " size=", false, 1, r.size)
+      && readField(pos, last, " base=", true, 8, r.base) && readField(pos, last, " offset=", true, 8, r.offset)
+      && readField(pos, last, " length=", false, 9, r.length) && pos == last && (r.size == 2 || r.size == 4);
+}
+
+/**
+* Inserts a script dumped along with records, which tell where the pointer
+* and the text of each block were found. The blocks are packed into the room
+* taken by the original ones, in the order they're found in the script, and
+* their pointers are patched in place. Blocks left out of the script keep
+* their original text, so partial scripts can be inserted too.
+* @param script Text script to be inserted, each block starting with its record.
+* @param newsessions Whether new sessions are allowed in the text.
+* @param dtes Whether DTEs can be used to encode the text.
+*/
+void TextInserter::insertIntoRecords (const string &script, bool newsessions, bool dtes)
 {
+   u8 *dataPtr = m_data.first.get();
+   u32 dataLen = m_data.second;
+
+   ScriptLexer lexer(m_tbl, script.data(), script.data() + script.size(), newsessions);
+   shared_array<u8> buffer(new u8[script.size() + 1]);
+   u32 bufferLen = 0;
+
+   vector<BlockRecord> records;
+   vector<u32> offsets;
+   vector<int> sharing;
+   vector<pair<u32, u32> > room;
+   map<u32, int> firstAt;
+
+   // checks every record against the file before anything gets changed
+   for (u32 i = 0; ; i++)
+   {
+      string number = boost::lexical_cast<string>(i), record;
+      ScriptLexer::Token end;
+
+      u32 blockLen = encodeBlock(lexer, buffer.get() + bufferLen, end, dtes, &record);
+
+      // the text after the last separator is left out
+      if (end.type != ScriptLexer::BlockEnd) break;
+
+      BlockRecord r;
+      if (!parseRecord(record, r))
+         throw exception(("Block " + number + " doesn't start with a valid record.").c_str());
+
+      if (r.slot + r.size > dataLen || !r.length || r.offset + r.length > dataLen || dataPtr[r.offset + r.length - 1] != 0x00)
+         throw exception(("Block " + number + " lies outside of the file.").c_str());
+
+      u32 pointer = r.size == 2 ? *((u16 *)(dataPtr + r.slot)) : *((u32 *)(dataPtr + r.slot));
+
+      if (r.offset < r.base || pointer != r.offset - r.base)
+         throw exception(("Block " + number + " doesn't match the file (was it dumped from another one?).").c_str());
+
+      // a block left empty points to the text of the first one found at the same offset
+      if (end.shared >= 0 && !blockLen)
+      {
+         map<u32, int>::iterator found = firstAt.find(r.offset);
+         if (found == firstAt.end()) throw exception(("Block " + number + " shares the text of a block missing from the script.").c_str());
+
+         sharing.push_back(found->second);
+         offsets.push_back(offsets[found->second]);
+      }
+      else
+      {
+         firstAt.insert(make_pair(r.offset, static_cast<int>(i)));
+         room.push_back(make_pair(r.offset, r.offset + r.length));
+         sharing.push_back(-1);
+
+         offsets.push_back(bufferLen);
+         bufferLen += blockLen;
+         buffer[bufferLen++] = 0x00;
+      }
+
+      records.push_back(r);
+   }
+
+   // the room of the original blocks, merging the ones next to each other
+   sort(room.begin(), room.end());
+   vector<pair<u32, u32> > spans;
+   u32 available = 0;
+
+   for (vector<pair<u32, u32> >::iterator i = room.begin(); i != room.end(); ++i)
+   {
+      if (!spans.empty() && i->first <= spans.back().second)
+         spans.back().second = max(spans.back().second, i->second);
+      else
+         spans.push_back(*i);
+   }
+
+   for (vector<pair<u32, u32> >::iterator i = spans.begin(); i != spans.end(); ++i)
+      available += i->second - i->first;
+
+   if (measured(available, 0, bufferLen, true)) return;
+
+   // each block takes the first piece of room it fits in
+   vector<pair<u32, u32> > left = spans;
+   vector<u32> placed(records.size()), lengths(records.size(), 0);
+
+   for (u32 i = 0; i < records.size(); i++)
+   {
+      if (sharing[i] >= 0) continue;
+
+      u32 j = i + 1;
+      while (j < records.size() && sharing[j] >= 0) j++;
+
+      lengths[i] = (j < records.size() ? offsets[j] : bufferLen) - offsets[i];
+
+      vector<pair<u32, u32> >::iterator s = left.begin();
+      while (s != left.end() && s->second - s->first < lengths[i]) ++s;
+
+      if (s == left.end())
+         throw exception((boost::format("Block %1% (%2% bytes) doesn't fit in the room left by the original blocks "
+            "(%3% bytes needed in all, %4% available).") % i % lengths[i] % bufferLen % available).str().c_str());
+
+      placed[i] = s->first;
+      s->first += lengths[i];
+   }
+
+   for (u32 i = 0; i < records.size(); i++)
+   {
+      if (sharing[i] >= 0) placed[i] = placed[sharing[i]];
+
+      const BlockRecord &r = records[i];
+
+      if (placed[i] < r.base || (r.size == 2 && placed[i] - r.base > 0xffff))
+         throw exception(("The pointer of block " + boost::lexical_cast<string>(i) + " can't reach its new position.").c_str());
+   }
+
+   // the file is only changed once everything fits
+   for (vector<pair<u32, u32> >::iterator i = spans.begin(); i != spans.end(); ++i)
+      fill(dataPtr + i->first, dataPtr + i->second, 0x00);
+
+   for (u32 i = 0; i < records.size(); i++)
+   {
+      const BlockRecord &r = records[i];
+
+      if (sharing[i] < 0)
+         copy(buffer.get() + offsets[i], buffer.get() + offsets[i] + lengths[i], dataPtr + placed[i]);
+
+      if (r.size == 2) *((u16 *)(dataPtr + r.slot)) = static_cast<u16>(placed[i] - r.base);
+      else *((u32 *)(dataPtr + r.slot)) = placed[i] - r.base;
+   }
+}
+
+/**
+* Encodes every block of a script, each one followed by a 0x00. Blocks
+* sharing the text of an earlier one point to it instead, unless they
+* were given their own text. Anything after the last separator is left out.
+* @param script Text script to be encoded.
+* @param buffer Where the encoded text will be written to.
+* @param pointers Where the offset of each block will be appended.
+* @param newsessions Whether three line breaks in a row start a new session.
+* @param dtes Whether DTEs can be used to encode the text.
+* @return Number of bytes written.
+*/
+u32 TextInserter::encodeScript (const string &script, u8 *buffer, vector<u32> &pointers, bool newsessions, bool dtes)
+{
+   ScriptLexer lexer(m_tbl, script.data(), script.data() + script.size(), newsessions);
+   ScriptLexer::Token end;
    u32 bufferPos = 0;
 
-   // encodes the script content on a block basis
-   for (vector<string>::iterator i = lines.begin(); i != lines.end(); ++i)
+   for (;;)
    {
+      u32 blockLen = encodeBlock(lexer, buffer + bufferPos, end, dtes);
+      if (end.type != ScriptLexer::BlockEnd) break;
+
+      if (end.shared >= 0 && !blockLen)
+      {
+         if (end.shared >= static_cast<int>(pointers.size())) throw exception("A block can only share the text of an earlier one.");
+
+         pointers.push_back(pointers[end.shared]);
+         continue;
+      }
+
       pointers.push_back(bufferPos);
-      if (i->size()) bufferPos += translateBlock(*i, buffer + bufferPos, newsessions, dtes);
-      
+      bufferPos += blockLen;
+
       buffer[bufferPos++] = 0x00;
    }
 
@@ -644,68 +1095,135 @@ u32 TextInserter::encodeScript (vector<string> &lines, u8 *buffer, vector<u32> &
 }
 
 /**
-* Encodes a given script block into the binary format used in FF8.
-* @param block The script block to be encoded.
-* @param buffer Buffer where the resulting binary data will be written to.
-* @return Number of bytes written to the buffer.
+* Encodes the tokens of a block, up to its separator (or the end of the script).
+* Each piece of text is encoded on its own, since DTEs can't span codes or
+* line breaks. Blocks found in the cache are copied from it instead.
+* @param lexer Where the tokens are read from.
+* @param buffer Where the encoded text will be written to.
+* @param token Set to the token ending the block (BlockEnd or End).
+* @param dtes Whether DTEs can be used to encode the text.
+* @param record Where the record of the block is stored (null if there can't be one).
+* @return Number of bytes written.
 */
-u32 TextInserter::translateBlock (const string &block, u8 *buffer, bool newsessions, bool dtes)
+u32 TextInserter::encodeBlock (ScriptLexer &lexer, u8 *buffer, ScriptLexer::Token &token, bool dtes, string *record)
 {
+   const DictionaryTrie &trie = m_tbl.trie();
    u32 tail = 0;
-   vector<string> sessions;
 
-   // splits the script into sections delimited by newsessions (if specified)
-   newsessions ?
-      boost::split_regex(sessions, block, boost::regex("\\n{3}")) :
-      sessions.push_back(block);
+   // blocks starting with records are never cached, as their records must be read
+   const char *last = m_cache && !record ? lexer.blockEnd() : 0;
+   BlockCache::key_type key;
 
-   for (vector<string>::iterator i = sessions.begin(); i != sessions.end(); ++i)
+   if (last)
    {
-      vector<string> subs;
-      boost::split(subs, *i, boost::is_any_of("[]"));
+      u32 flags = (dtes ? 1 : 0) | (lexer.newsessions() ? 2 : 0) | (m_encoding << 2);
+      key = BlockCache::key(lexer.position(), last, flags);
 
-      for (vector<string>::iterator j = subs.begin(); j != subs.end(); ++j)
+      if (m_cache->find(key, buffer, tail))
       {
-         if (j->size())
-         {
-            if (j->at(0) == '$')
-            {
-               string hex = j->substr(1);
-               
-               if (hex.size() == 2)
-                  buffer[tail++] = hexDecode<u8>(hex);
-               else
-               {
-                  u16 value = hexDecode<u16>(hex);
-                  buffer[tail++] = value >> 8;
-                  buffer[tail++] = value & 0xff;
-               }
-            }
-            else
-            {
-               for (string::iterator k = j->begin(); k != j->end(); ++k)
-               {
-                  if (*k == '\n')
-                     buffer[tail++] = 0x02;
-                  else if (dtes && k + 1 != j->end() && m_tbl.exists<u8>(string(k, k + 2)))
-                     buffer[tail++] = m_tbl.find<u8>(string(k, k + 2)), ++k;
-                  else
-                  {
-                     string token(1, *k);
-
-                     if (m_tbl.exists<u8>(token))
-                        buffer[tail++] = m_tbl.find<u8>(token);
-                     else
-                        throw exception("Translation error!");
-                  }
-               }
-            }
-         }
+         lexer.seek(last);
+         lexer.next(token);
+         return tail;
       }
+   }
 
-      // newsession
-      if (i + 1 != sessions.end()) buffer[tail++] = 0x01;
+   while (lexer.next(token) && token.type != ScriptLexer::BlockEnd)
+   {
+      switch (token.type)
+      {
+         case ScriptLexer::Text:
+            tail += trie.encode(token.first, token.last, buffer + tail, dtes, m_encoding == Optimal);
+            break;
+
+         case ScriptLexer::Code:
+            copy(token.code, token.code + token.codeLen, buffer + tail);
+            tail += token.codeLen;
+            break;
+
+         case ScriptLexer::NewLine:
+            buffer[tail++] = 0x02;
+            break;
+
+         case ScriptLexer::NewSession:
+            buffer[tail++] = 0x01;
+            break;
+
+         case ScriptLexer::Record:
+            if (!record) throw exception("Found a record in a script dumped without them.");
+            record->assign(token.first, token.last);
+            break;
+      }
    }
 
+   // only cached if the lexer ended the block where it was expected to
+   if (last && token.first == last) m_cache->insert(key, buffer, buffer + tail);
+
    return tail;
+}
+
+/**
+* Stores each block pointed to once, leaving out the ones found at the end
+* of another block (identical ones included), whose pointers point inside
+* it instead. Sorted by their bytes read backwards, a block comes right
+* before the ones it's found at the end of, so it's enough to compare each
+* block with the next one. A block runs up to the start of the next one, as
+* encoded, since the second byte of a code may be 0x00 too.
+* @param data Encoded text data.
+* @param dataLen End of the text of the last block, relative to the data.
+* @param first First pointer to the blocks, relative to the data.
+* @param last End of the pointers, which are made relative to the compacted blocks.
+* @param dest Where the compacted blocks will be written to.
+* @return Number of bytes written.
+*/
+u32 TextInserter::compactBlocks (const u8 *data, u32 dataLen, vector<u16>::iterator first, vector<u16>::iterator last, u8 *dest)
+{
+   vector<u16> starts(first, last);
+   sort(starts.begin(), starts.end());
+   starts.erase(unique(starts.begin(), starts.end()), starts.end());
+
+   u32 numBlocks = static_cast<u32>(starts.size());
+   vector<pair<const u8 *, u32> > blocks(numBlocks);
+   vector<u32> order(numBlocks), owner(numBlocks), placed(numBlocks);
+
+   for (u32 i = 0; i < numBlocks; i++)
+   {
+      u32 end = i + 1 < numBlocks ? starts[i + 1] : dataLen;
+      blocks[i] = make_pair(data + starts[i], end - starts[i]);
+      order[i] = i;
+   }
+
+   sort(order.begin(), order.end(), ReversedLess(blocks));
+
+   // each block is stored inside the longest block it's found at the end of
+   for (u32 i = numBlocks; i-- > 0; )
+   {
+      const pair<const u8 *, u32> &cur = blocks[order[i]];
+      owner[order[i]] = order[i];
+
+      if (i + 1 < numBlocks)
+      {
+         const pair<const u8 *, u32> &next = blocks[order[i + 1]];
+
+         if (cur.second <= next.second && equal(cur.first, cur.first + cur.second, next.first + next.second - cur.second))
+            owner[order[i]] = owner[order[i + 1]];
+      }
+   }
+
+   u32 destLen = 0;
+
+   for (u32 i = 0; i < numBlocks; i++)
+   {
+      if (owner[i] != i) continue;
+
+      placed[i] = destLen;
+      destLen = static_cast<u32>(copy(blocks[i].first, blocks[i].first + blocks[i].second, dest + destLen) - dest);
+   }
+
+   for (u32 i = 0; i < numBlocks; i++)
+      if (owner[i] != i) placed[i] = placed[owner[i]] + blocks[owner[i]].second - blocks[i].second;
+
+   for (vector<u16>::iterator i = first; i != last; ++i)
+      *i = static_cast<u16>(placed[lower_bound(starts.begin(), starts.end(), *i) - starts.begin()]);
+
+   return destLen;
 }
\ No newline at end of file
@@ -23,36 +23,114 @@
 #include "dictionary.hpp"
 #include "data_structure.hpp"
 #include "pointerdesc.hpp"
+#include "text_format.hpp"
+#include "script_lexer.hpp"
+#include "block_cache.hpp"
 
+#include <set>
 #include <vector>
 #include <utility>
+#include <exception>
 #include <boost/shared_array.hpp>
 
-class TextInserter
+class TextInserter : public TextFormat
 {
 public:
    typedef std::pair<boost::shared_array<u8>, u32> filedata_type;
 
+   /** A text section of the file, inserted along with the others */
+   typedef struct tagFF8ScriptSection {
+      tagFF8ScriptSection (const std::string &text = "", int fmt = -1, u32 ptr = 0, u32 txt = 0) :
+         script(text), type(fmt), ptrOff(ptr), txtOff(txt) { }
+
+      std::string script; /**< Text script to be inserted.                   */
+      int type;           /**< Format of the section.                        */
+      u32 ptrOff;         /**< Offset of the pointers table.                 */
+      u32 txtOff;         /**< Offset of the text data, in the original file. */
+      std::string error;  /**< Why the insertion failed (empty if it didn't). */
+   } Section;
+
+   /** Room taken by a text section, as found by a dry run */
+   typedef struct tagFF8SectionCapacity {
+      tagFF8SectionCapacity () : original(0), slack(0), encoded(0), limited(false) { }
+
+      u32 original; /**< Bytes taken by the original text.                        */
+      u32 slack;    /**< Bytes of padding after it, which the new text may take.  */
+      u32 encoded;  /**< Bytes the new text takes, laid out the same way.         */
+      bool limited; /**< Whether the new text must fit in the original room.      */
+   } Capacity;
+
    TextInserter (const filedata_type &data, const Dictionary &dic) :
-      m_data(data), m_tbl(dic) { }
+      m_data(data), m_tbl(dic), m_encoding(Optimal), m_cache(0), m_compaction(false), m_capacity(0) { }
 
    enum {
-      Battle,     /**< Field Battle files (.dat)       */
-      Field,      /**< Field Dialogs files (.msd)      */
-      Linear,     /**< Misc files with linear pointers */
-      Packed,     /**< Main Menu files                 */
-      SeedTest,   /**< SeeD Test files                 */
-      Refines,    /**< Refine System files             */
-      MenuHelp,   /**< Help System files               */
-      MenuBattle, /**< Battle Menu System files        */
-      MainMenu    /**< Main menu basic entries data    */
+      Greedy,  /**< Takes the longest dictionary entry at each position */
+      Optimal  /**< Uses the fewest bytes possible for each block       */
    };
 
    void insert (const std::string &script, int type, u32 ptrOff = 0, u32 txtOff = 0);
+   void insert (std::vector<Section> &sections);
+   Capacity measure (const std::string &script, int type, u32 ptrOff = 0, u32 txtOff = 0);
+
+   /**
+   * Changes the way text is encoded (Optimal by default).
+   * @param mode Either Greedy or Optimal.
+   */
+   void encoding (int mode) { m_encoding = mode; }
+
+   /**
+   * Sets the cache of encoded blocks, so the blocks found in it aren't
+   * encoded again (none by default). It must be built with the same table.
+   * @param cache The cache, null to encode every block.
+   */
+   void cache (BlockCache *cache) { m_cache = cache; }
+
+   /**
+   * Changes whether identical blocks, and blocks found at the end of
+   * others, share their storage (off by default). Only used by Packed,
+   * Refines and MainMenu files, whose blocks are all read through pointers.
+   * @param enable Whether the blocks are compacted.
+   */
+   void compaction (bool enable) { m_compaction = enable; }
 
    filedata_type getModifiedFile () { return m_data; }
 
 private:
+   /** Where the pointer and the text of a block were found, as written by the dumper */
+   typedef struct tagFF8BlockRecord {
+      u32 slot;   /**< Offset of the pointer.                   */
+      u32 size;   /**< Size of the pointer, in bytes.           */
+      u32 base;   /**< Offset the pointer is relative to.       */
+      u32 offset; /**< Offset of the text.                      */
+      u32 length; /**< Length of the text, with its terminator. */
+   } BlockRecord;
+
+   /** Text whose length changed, spliced into the file once every section is inserted */
+   typedef struct tagFF8TextSplice {
+      bool operator< (const tagFF8TextSplice &other) const { return offset < other.offset; }
+
+      u32 offset;         /**< Offset of the old text in the original file.         */
+      u32 length;         /**< Length of the old text.                              */
+      u32 field;          /**< Header field holding the offset of the old text.     */
+      filedata_type data; /**< The new text.                                        */
+   } Splice;
+
+   struct ScriptInsertion;
+
+   template <class Format> void insertAs (const std::string &script, u32 ptrOff, u32 txtOff, bool records);
+
+   void insertInto (FormatTraits<Battle>, const filedata_type &d, std::vector<u16> &p, u32, u32) { insertIntoBattleScene(d, p); }
+   void insertInto (FormatTraits<Field>, const filedata_type &d, std::vector<u32> &p, u32, u32) { insertIntoFieldDialogs(d, p); }
+   void insertInto (FormatTraits<Packed>, const filedata_type &d, std::vector<u16> &p, u32 ptrOff, u32) { insertIntoPackedData(d, p, ptrOff); }
+   void insertInto (FormatTraits<Refines>, const filedata_type &d, std::vector<u16> &p, u32 ptrOff, u32 txtOff) { insertIntoRefinesData(d, p, ptrOff, txtOff); }
+   void insertInto (FormatTraits<MenuBattle>, const filedata_type &d, std::vector<u16> &p, u32 ptrOff, u32 txtOff) { insertIntoMenuBattleData(d, p, ptrOff, txtOff); }
+   void insertInto (FormatTraits<MainMenu>, const filedata_type &d, std::vector<u16> &p, u32 ptrOff, u32) { insertIntoMainMenuData(d, p, ptrOff); }
+
+   /** Formats whose files can't be rebuilt (their scripts can still be inserted along with records) */
+   template <class Format> void insertInto (Format, const filedata_type &, std::vector<typename Format::pointer_type> &, u32, u32) {
+      throw std::exception("TextInserter is unable to insert into the specified file type.");
+   }
+
    void insertIntoBattleScene (const filedata_type &scriptData, std::vector<u16> &pointers);
    void insertIntoFieldDialogs (const filedata_type &scriptData, std::vector<u32> &pointers);
    void insertIntoLinearData (const filedata_type &scriptData, std::vector<u16> &pointers, u32 ptrOff);
@@ -61,9 +139,15 @@ private:
    void insertIntoMenuHelpData (std::vector<filedata_type> &encBlocks, u32 ptrOff, u32 txtOff);
    void insertIntoMenuBattleData (const filedata_type &scriptData, std::vector<u16> &pointers, u32 ptrOff, u32 txtOff);
    void insertIntoMainMenuData (const filedata_type &scriptData, std::vector<u16> &pointers, u32 ptrOff);
+   void insertIntoRecords (const std::string &script, bool newsessions, bool dtes);
+   void insertSection (const std::string &script, int type, u32 ptrOff, u32 txtOff);
+   bool measured (u32 original, u32 slack, u32 encoded, bool limited);
+   void assemble ();
    
-   u32 encodeScript (std::vector<std::string> &lines, u8 *buffer, std::vector<u32> &pointers, bool newsessions = true, bool dtes = true);
-   u32 translateBlock (const std::string &block, u8 *buffer, bool newsessions = true, bool dtes = true);
+   u32 encodeScript (const std::string &script, u8 *buffer, std::vector<u32> &pointers, bool newsessions = true, bool dtes = true);
+   u32 encodeBlock (ScriptLexer &lexer, u8 *buffer, ScriptLexer::Token &token, bool dtes = true, std::string *record = 0);
+   u32 compactBlocks (const u8 *data, u32 dataLen, std::vector<u16>::iterator first, std::vector<u16>::iterator last, u8 *dest);
+   static bool parseRecord (const std::string &record, BlockRecord &r);
 
    /**
    * Calculates the padding necessary to align a specified value into a certain boundary.
@@ -79,6 +163,13 @@ private:
 
    const Dictionary &m_tbl;
    PointerDescription m_ptrdesc;
+   int m_encoding;
+   BlockCache *m_cache;
+   bool m_compaction;
+   Capacity *m_capacity; /**< Where a dry run stores the sizes (null when inserting). */
+
+   std::vector<Splice> m_splices; /**< Text to be spliced into the file.                 */
+   std::set<u32> m_offsetFields;  /**< Header fields holding offsets of the text data.   */
 };
 
 #endif //~TEXTINSERTER_HPP
\ No newline at end of file